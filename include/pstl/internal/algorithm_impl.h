@@ -26,12 +26,22 @@
 #include <utility>
 #include <functional>
 #include <algorithm>
+#include <string>
+#include <cstdint>
 
 #include "execution_policy_impl.h"
 #include "simd_impl.h"
 
+#if __PSTL_CPP17_STRING_VIEW_PRESENT
+    #include <string_view>
+#endif
+
 #if __PSTL_USE_TBB
     #include "parallel_impl_tbb.h"
+#elif __PSTL_USE_OMP
+    #include "parallel_impl_omp.h"
+#elif __PSTL_USE_THREAD
+    #include "parallel_impl_thread.h"
 #else
     __PSTL_PRAGMA_MESSAGE("Backend was not specified");
 #endif
@@ -1125,38 +1135,674 @@ pattern_partition_copy(InputIterator first, InputIterator last, OutputIterator1
 // sort
 //------------------------------------------------------------------------
 
-template<class RandomAccessIterator, class Compare, class IsVector, class IsMoveConstructible>
-void pattern_sort(RandomAccessIterator first, RandomAccessIterator last, Compare comp, IsVector /*is_vector*/, /*is_parallel=*/std::false_type, IsMoveConstructible) noexcept {
+template<class T, class Compare>
+struct is_std_less: std::false_type {};
+
+template<class T>
+struct is_std_less<T, std::less<T>>: std::true_type {};
+
+template<class T, class Compare>
+struct is_std_greater: std::false_type {};
+
+template<class T>
+struct is_std_greater<T, std::greater<T>>: std::true_type {};
+
+#if __PSTL_CPP14_TRANSPARENT_COMPARATORS_PRESENT
+template<class T>
+struct is_std_less<T, std::less<>>: std::true_type {};
+
+template<class T>
+struct is_std_greater<T, std::greater<>>: std::true_type {};
+#endif
+
+template<class T, class Compare>
+struct is_std_order: std::integral_constant<bool, is_std_less<T, Compare>::value || is_std_greater<T, Compare>::value> {};
+
+//------------------------------------------------------------------------
+// sort of strings
+//------------------------------------------------------------------------
+
+template<class T>
+struct is_char_string: std::false_type {};
+
+template<class Alloc>
+struct is_char_string<std::basic_string<char, std::char_traits<char>, Alloc>>: std::true_type {};
+
+#if __PSTL_CPP17_STRING_VIEW_PRESENT
+template<>
+struct is_char_string<std::string_view>: std::true_type {};
+#endif
+
+//! True if the strings can be sorted character by character instead of by comparisons
+template<class T, class Compare>
+struct is_string_sortable: std::integral_constant<bool, is_char_string<T>::value && is_std_less<T, Compare>::value> {};
+
+//! Number of characters examined by a step of the string sort
+const std::size_t STRING_SORT_CHUNK = 7;
+
+//! Characters d, ..., d+STRING_SORT_CHUNK-1 of s packed so that integer order is string order
+/** The low byte holds the number of characters present, so a string that ends in the chunk
+    orders before any longer string with the same characters. */
+template<class String>
+uint64_t string_chunk(const String& s, std::size_t d) noexcept {
+    const std::size_t n = d < s.size() ? std::min(s.size() - d, STRING_SORT_CHUNK) : 0;
+    uint64_t key = 0;
+    for(std::size_t i = 0; i < n; ++i)
+        key |= uint64_t(static_cast<unsigned char>(s[d + i])) << (8*(STRING_SORT_CHUNK - i));
+    return key | n;
+}
+
+//! Pointer to a string with a cached chunk of its characters
+/** Sorting these compact items touches the strings only to refill the cache. */
+template<class String>
+struct string_sort_item {
+    uint64_t key;
+    String* str;
+};
+
+//! Comparison of items whose strings are known to have equal first d characters
+template<class String>
+bool string_item_less(const string_sort_item<String>& x, const string_sort_item<String>& y, std::size_t d) noexcept {
+    if(x.key != y.key)
+        return x.key < y.key;
+    if((x.key & 0xff) < STRING_SORT_CHUNK)
+        return false;
+    d += STRING_SORT_CHUNK;
+    const std::size_t n = std::min(x.str->size(), y.str->size()) - d;
+    const int r = String::traits_type::compare(x.str->data() + d, y.str->data() + d, n);
+    return r < 0 || (r == 0 && x.str->size() < y.str->size());
+}
+
+//! Three-way partition of [first, last) by cached key, with the equal items ending up in the middle
+template<class String>
+std::pair<string_sort_item<String>*, string_sort_item<String>*>
+string_partition(string_sort_item<String>* first, string_sort_item<String>* last, uint64_t& pivot) noexcept {
+    // Median of three
+    uint64_t a = first->key;
+    uint64_t b = first[(last - first) / 2].key;
+    const uint64_t c = (last - 1)->key;
+    if(a > b)
+        std::swap(a, b);
+    pivot = c < a ? a : (c > b ? b : c);
+
+    string_sort_item<String>* lt = first;
+    string_sort_item<String>* gt = last;
+    while(first != gt) {
+        if(first->key < pivot)
+            std::swap(*lt++, *first++);
+        else if(first->key > pivot)
+            std::swap(*first, *--gt);
+        else
+            ++first;
+    }
+    return std::make_pair(lt, gt);
+}
+
+//! Advance the cached keys of [first, last) to position d
+template<class String>
+void string_refill(string_sort_item<String>* first, string_sort_item<String>* last, std::size_t d) noexcept {
+    for(; first != last; ++first)
+        first->key = string_chunk(*first->str, d);
+}
+
+const std::size_t STRING_SORT_INSERTION_CUT_OFF = 16;
+const std::size_t STRING_SORT_PARALLEL_CUT_OFF = 2000;
+
+//! Multikey quicksort of items with keys cached at position d (J. Bentley, R. Sedgewick, SODA '97)
+/** Characters of a common prefix are examined once per string, instead of once per comparison.
+    Each partitioning step consumes STRING_SORT_CHUNK characters rather than one. */
+template<class String>
+void brick_string_sort(string_sort_item<String>* first, string_sort_item<String>* last, std::size_t d) noexcept {
+    while(std::size_t(last - first) > STRING_SORT_INSERTION_CUT_OFF) {
+        uint64_t pivot;
+        const std::pair<string_sort_item<String>*, string_sort_item<String>*> eq = string_partition(first, last, pivot);
+        brick_string_sort(first, eq.first, d);
+        brick_string_sort(eq.second, last, d);
+        // Strings that ended in the chunk are equal
+        if((pivot & 0xff) < STRING_SORT_CHUNK)
+            return;
+        first = eq.first;
+        last = eq.second;
+        d += STRING_SORT_CHUNK;
+        string_refill(first, last, d);
+    }
+    for(string_sort_item<String>* i = first; i != last; ++i)
+        for(string_sort_item<String>* j = i; j != first && string_item_less(*j, *(j - 1), d); --j)
+            std::swap(*j, *(j - 1));
+}
+
+template<class String>
+void parallel_string_sort(string_sort_item<String>* first, string_sort_item<String>* last, std::size_t d) {
+    if(std::size_t(last - first) <= STRING_SORT_PARALLEL_CUT_OFF) {
+        brick_string_sort(first, last, d);
+        return;
+    }
+    uint64_t pivot;
+    const std::pair<string_sort_item<String>*, string_sort_item<String>*> eq = string_partition(first, last, pivot);
+    par_backend::parallel_invoke(
+        [=]() { parallel_string_sort(first, eq.first, d); },
+        [=]() {
+            par_backend::parallel_invoke(
+                [=]() {
+                    if((pivot & 0xff) == STRING_SORT_CHUNK) {
+                        string_refill(eq.first, eq.second, d + STRING_SORT_CHUNK);
+                        parallel_string_sort(eq.first, eq.second, d + STRING_SORT_CHUNK);
+                    }
+                },
+                [=]() { parallel_string_sort(eq.second, last, d); });
+        });
+}
+
+//! True if simd_sort can be used for values of type T
+/** Sorting networks are not stable, so a stable sort needs equivalent values to be identical. */
+template<class T, class Compare, class IsStable>
+struct is_simd_sortable: std::is_arithmetic<T> {};
+
+template<class T, class Compare>
+struct is_simd_sortable<T, Compare, /*is_stable=*/std::true_type>:
+    std::integral_constant<bool, std::is_integral<T>::value && is_std_order<T, Compare>::value> {};
+
+template<class RandomAccessIterator, class Compare>
+bool brick_simd_sort(RandomAccessIterator first, RandomAccessIterator last, Compare comp, /*is_simd_sortable=*/std::false_type) noexcept {
+    return false;
+}
+
+template<class RandomAccessIterator, class Compare>
+bool brick_simd_sort(RandomAccessIterator first, RandomAccessIterator last, Compare comp, /*is_simd_sortable=*/std::true_type) noexcept {
+    if(last - first > typename std::iterator_traits<RandomAccessIterator>::difference_type(SIMD_SORT_MAX_SIZE))
+        return false;
+    simd_sort(first, last - first, comp);
+    return true;
+}
+
+template<class RandomAccessIterator, class Compare>
+void brick_sort(RandomAccessIterator first, RandomAccessIterator last, Compare comp, /*is_vector=*/std::false_type) noexcept {
     std::sort(first, last, comp);
 }
 
+template<class RandomAccessIterator, class Compare>
+void brick_sort(RandomAccessIterator first, RandomAccessIterator last, Compare comp, /*is_vector=*/std::true_type) noexcept {
+    typedef typename std::iterator_traits<RandomAccessIterator>::value_type T;
+    if(!brick_simd_sort(first, last, comp, typename is_simd_sortable<T, Compare, std::false_type>::type()))
+        std::sort(first, last, comp);
+}
+
+//------------------------------------------------------------------------
+// parallel_sample_sort
+//
+// Unstable sort for large ranges. Elements are classified into buckets by a
+// tree of sampled splitters, scattered once into a temporary buffer, and the
+// buckets are sorted independently. Each element is moved a constant number
+// of times, instead of once per level of the merge tree in parallel_stable_sort.
+//------------------------------------------------------------------------
+
+//! Minimal number of elements for which sample sort is used.
+const std::size_t SAMPLE_SORT_CUT_OFF = 1<<14;
+//! Minimal size in bytes of the sorted range for which sample sort is used.
+/** Smaller ranges fit in cache, where extra passes of the merge sort are cheap. */
+const std::size_t SAMPLE_SORT_MIN_BYTES = 1<<16;
+//! Binary logarithm of the maximal number of buckets; bucket ids are kept in uint8_t.
+const std::size_t SAMPLE_SORT_MAX_LOG_BUCKETS = 8;
+//! Minimal expected number of elements in a bucket.
+const std::size_t SAMPLE_SORT_MIN_BUCKET_SIZE = 1024;
+//! Number of sample elements per bucket.
+const std::size_t SAMPLE_SORT_OVERSAMPLING = 16;
+//! Number of classification blocks per thread, for load balancing.
+const std::size_t SAMPLE_SORT_BLOCKS_PER_THREAD = 4;
+
+template<typename RandomAccessIterator, typename Compare, typename LeafSort>
+void parallel_sample_sort( RandomAccessIterator xs, RandomAccessIterator xe, Compare comp, LeafSort leaf_sort ) {
+    typedef typename std::iterator_traits<RandomAccessIterator>::value_type T;
+    typedef typename std::iterator_traits<RandomAccessIterator>::difference_type difference_type;
+    const std::size_t n = xe - xs;
+    if( n < SAMPLE_SORT_CUT_OFF || n*sizeof(T) < SAMPLE_SORT_MIN_BYTES ) {
+        par_backend::parallel_stable_sort( xs, xe, comp, leaf_sort );
+        return;
+    }
+    Compare cmp(comp);
+    // The number of buckets is a power of two, so that the splitter tree is complete.
+    std::size_t log_k = 1;
+    while( log_k < SAMPLE_SORT_MAX_LOG_BUCKETS && (n >> (log_k+1)) >= SAMPLE_SORT_MIN_BUCKET_SIZE )
+        ++log_k;
+    const std::size_t k = std::size_t(1) << log_k;
+    const std::size_t s = k * SAMPLE_SORT_OVERSAMPLING;
+    const std::size_t m = std::max<std::size_t>(1, std::min<std::size_t>(n / SAMPLE_SORT_MIN_BUCKET_SIZE,
+                                                          SAMPLE_SORT_BLOCKS_PER_THREAD * par_backend::max_concurrency()));
+    const std::size_t block_size = (n-1)/m + 1;
+
+    par_backend::raw_buffer buf( sizeof(T)*n );
+    par_backend::raw_buffer id_buf( sizeof(uint8_t)*n );
+    par_backend::raw_buffer count_buf( sizeof(std::size_t)*(m*k + k + 1) );
+    par_backend::raw_buffer sample_buf( sizeof(difference_type)*(s + k) );
+    if( !buf || !id_buf || !count_buf || !sample_buf ) {
+        // Not enough memory available - fall back on merge sort
+        par_backend::parallel_stable_sort( xs, xe, comp, leaf_sort );
+        return;
+    }
+    T* const tmp = static_cast<T*>(buf.get());
+    uint8_t* const id = static_cast<uint8_t*>(id_buf.get());
+    std::size_t* const count = static_cast<std::size_t*>(count_buf.get());
+    std::size_t* const bucket = count + m*k;
+    difference_type* const sample = static_cast<difference_type*>(sample_buf.get());
+    difference_type* const tree = sample + s;
+
+    // Pick a deterministic pseudo-random sample and sort it.
+    uint64_t state = n;
+    for( std::size_t i = 0; i < s; ++i ) {
+        state = state*6364136223846793005ULL + 1442695040888963407ULL;
+        sample[i] = difference_type((state >> 33) % n);
+    }
+    std::sort(sample, sample + s, [&cmp, xs](difference_type a, difference_type b) { return cmp(xs[a], xs[b]); });
+
+    // Lay out k-1 equidistant splitters as an implicit binary tree: children of node j are 2*j and 2*j+1.
+    for( std::size_t level = 0; level < log_k; ++level ) {
+        const std::size_t stride = k >> (level+1);
+        for( std::size_t j = std::size_t(1) << level; j < std::size_t(2) << level; ++j )
+            tree[j] = sample[(2*(j - (std::size_t(1) << level)) + 1) * stride * SAMPLE_SORT_OVERSAMPLING];
+    }
+
+    // Classify elements and count bucket sizes per block.
+    par_backend::parallel_for(std::size_t(0), m, [=, &cmp](std::size_t bi, std::size_t be) {
+        for( ; bi != be; ++bi ) {
+            std::size_t* const c = count + bi*k;
+            std::fill(c, c + k, std::size_t(0));
+            const std::size_t ie = std::min(n, (bi+1)*block_size);
+            for( std::size_t i = bi*block_size; i < ie; ++i ) {
+                std::size_t j = 1;
+                // Branch-free descent: comparison result selects the child.
+                for( std::size_t level = 0; level < log_k; ++level )
+                    j = 2*j + std::size_t(cmp(xs[tree[j]], xs[i]));
+                id[i] = uint8_t(j - k);
+                ++c[j - k];
+            }
+        }
+    });
+
+    // Turn counts into offsets of each block's portion of each bucket.
+    std::size_t sum = 0;
+    for( std::size_t b = 0; b < k; ++b ) {
+        bucket[b] = sum;
+        for( std::size_t bi = 0; bi < m; ++bi ) {
+            const std::size_t c = count[bi*k + b];
+            count[bi*k + b] = sum;
+            sum += c;
+        }
+    }
+    bucket[k] = n;
+
+    // Scatter elements into the buffer.
+    par_backend::parallel_for(std::size_t(0), m, [=](std::size_t bi, std::size_t be) {
+        for( ; bi != be; ++bi ) {
+            std::size_t* const c = count + bi*k;
+            const std::size_t ie = std::min(n, (bi+1)*block_size);
+            for( std::size_t i = bi*block_size; i < ie; ++i )
+                new(tmp + c[id[i]]++) T(std::move(xs[i]));
+        }
+    });
+
+    // Move each bucket back and sort it.
+    par_backend::parallel_for(std::size_t(0), k, [=, &cmp](std::size_t b, std::size_t be) {
+        for( ; b != be; ++b ) {
+            const std::size_t lo = bucket[b], hi = bucket[b+1];
+            std::move(tmp + lo, tmp + hi, xs + lo);
+            par_backend::serial_destroy()(tmp + lo, tmp + hi);
+            // A bucket much bigger than expected has many keys equal to a splitter, sort it in parallel.
+            if( (hi - lo)*k > 2*n )
+                par_backend::parallel_stable_sort( xs + lo, xs + hi, comp, leaf_sort );
+            else
+                leaf_sort( xs + lo, xs + hi, cmp );
+        }
+    });
+}
+
+template<class RandomAccessIterator, class Compare, class IsVector, class IsMoveConstructible>
+void pattern_sort(RandomAccessIterator first, RandomAccessIterator last, Compare comp, IsVector is_vector, /*is_parallel=*/std::false_type, IsMoveConstructible) noexcept {
+    brick_sort(first, last, comp, is_vector);
+}
+
+
+template<class RandomAccessIterator, class Compare, class IsVector>
+void pattern_sort_imp(RandomAccessIterator first, RandomAccessIterator last, Compare comp, IsVector is_vector, /*is_string_sortable=*/std::false_type) {
+    parallel_sample_sort(first, last, comp,
+        [is_vector](RandomAccessIterator first, RandomAccessIterator last, Compare comp) {
+        brick_sort(first, last, comp, is_vector);
+    });
+}
+
+template<class RandomAccessIterator, class Compare, class IsVector>
+void pattern_sort_imp(RandomAccessIterator first, RandomAccessIterator last, Compare comp, IsVector is_vector, /*is_string_sortable=*/std::true_type) {
+    typedef typename std::iterator_traits<RandomAccessIterator>::value_type T;
+    typedef string_sort_item<T> item_type;
+    const std::size_t n = last - first;
+    par_backend::raw_buffer item_buf(n*sizeof(item_type));
+    par_backend::raw_buffer tmp_buf(n*sizeof(T));
+    if(!item_buf || !tmp_buf) {
+        // Out of memory - use comparison sort
+        pattern_sort_imp(first, last, comp, is_vector, std::false_type());
+        return;
+    }
+    item_type* items = static_cast<item_type*>(item_buf.get());
+    T* tmp = static_cast<T*>(tmp_buf.get());
+    par_backend::parallel_for(std::size_t(0), n, [first, items](std::size_t i, std::size_t j) {
+        for(; i != j; ++i) {
+            items[i].str = &*(first + i);
+            items[i].key = string_chunk(*items[i].str, 0);
+        }
+    });
+    parallel_string_sort(items, items + n, 0);
+    // Permute the strings
+    par_backend::parallel_for(std::size_t(0), n, [items, tmp](std::size_t i, std::size_t j) {
+        for(; i != j; ++i)
+            new(tmp + i) T(std::move(*items[i].str));
+    });
+    par_backend::parallel_for(std::size_t(0), n, [first, tmp](std::size_t i, std::size_t j) {
+        for(; i != j; ++i) {
+            *(first + i) = std::move(tmp[i]);
+            tmp[i].~T();
+        }
+    });
+}
+
+template<class RandomAccessIterator, class Compare, class IsVector>
+void pattern_sort(RandomAccessIterator first, RandomAccessIterator last, Compare comp, IsVector is_vector, /*is_parallel=*/std::true_type, /*is_move_constructible=*/std::true_type ) {
+    typedef typename std::iterator_traits<RandomAccessIterator>::value_type T;
+    except_handler([=]() {
+        pattern_sort_imp(first, last, comp, is_vector, typename is_string_sortable<T, Compare>::type());
+    });
+}
+
+//------------------------------------------------------------------------
+// stable_sort
+//------------------------------------------------------------------------
+
+template<class RandomAccessIterator, class Compare>
+void brick_stable_sort(RandomAccessIterator first, RandomAccessIterator last, Compare comp, /*is_vector=*/std::false_type) noexcept {
+    std::stable_sort(first, last, comp);
+}
+
+template<class RandomAccessIterator, class Compare>
+void brick_stable_sort(RandomAccessIterator first, RandomAccessIterator last, Compare comp, /*is_vector=*/std::true_type) noexcept {
+    typedef typename std::iterator_traits<RandomAccessIterator>::value_type T;
+    if(!brick_simd_sort(first, last, comp, typename is_simd_sortable<T, Compare, std::true_type>::type()))
+        std::stable_sort(first, last, comp);
+}
+
+template<class RandomAccessIterator, class Compare, class IsVector>
+void pattern_stable_sort(RandomAccessIterator first, RandomAccessIterator last, Compare comp, IsVector is_vector, /*is_parallel=*/std::false_type) noexcept {
+    brick_stable_sort(first, last, comp, is_vector);
+}
 
 template<class RandomAccessIterator, class Compare, class IsVector>
-void pattern_sort(RandomAccessIterator first, RandomAccessIterator last, Compare comp, IsVector /*is_vector*/, /*is_parallel=*/std::true_type, /*is_move_constructible=*/std::true_type ) {
+void pattern_stable_sort(RandomAccessIterator first, RandomAccessIterator last, Compare comp, IsVector is_vector, /*is_parallel=*/std::true_type) {
     except_handler([=]() {
         par_backend::parallel_stable_sort(first, last, comp,
-            [](RandomAccessIterator first, RandomAccessIterator last, Compare comp) {
-            std::sort(first, last, comp);
+            [is_vector](RandomAccessIterator first, RandomAccessIterator last, Compare comp) {
+            brick_stable_sort(first, last, comp, is_vector);
         });
     });
 }
 
 //------------------------------------------------------------------------
-// stable_sort
+// sort_by_projection
 //------------------------------------------------------------------------
 
+template<class RandomAccessIterator, class Projection>
+struct projection_key {
+    typedef typename std::decay<typename std::result_of<
+        Projection(typename std::iterator_traits<RandomAccessIterator>::reference)>::type>::type type;
+};
+
+//! Key extracted from a record, and the position of the record in the input
+template<class Key>
+struct projection_item {
+    Key key;
+    std::size_t index;
+};
+
+//! Comparison of projection items by key
+/** For a stable sort ties are broken by position, so that any sort of the items is stable. */
+template<class Compare, class IsStable>
+class projection_item_compare {
+    Compare comp;
+public:
+    explicit projection_item_compare(Compare comp_): comp(comp_) {}
+    template<class Key>
+    bool operator()(const projection_item<Key>& x, const projection_item<Key>& y) const {
+        return comp(x.key, y.key);
+    }
+};
+
+template<class Compare>
+class projection_item_compare<Compare, /*is_stable=*/std::true_type> {
+    Compare comp;
+public:
+    explicit projection_item_compare(Compare comp_): comp(comp_) {}
+    template<class Key>
+    bool operator()(const projection_item<Key>& x, const projection_item<Key>& y) const {
+        return comp(x.key, y.key) || (!comp(y.key, x.key) && x.index < y.index);
+    }
+};
+
+//! Comparison of records by their projections
+template<class Projection, class Compare>
+class projected_compare {
+    Projection proj;
+    Compare comp;
+public:
+    projected_compare(Projection proj_, Compare comp_): proj(proj_), comp(comp_) {}
+    template<class T>
+    bool operator()(const T& x, const T& y) const {
+        return comp(proj(x), proj(y));
+    }
+};
+
 template<class RandomAccessIterator, class Compare, class IsVector>
-void pattern_stable_sort(RandomAccessIterator first, RandomAccessIterator last, Compare comp, IsVector /*is_vector*/, /*is_parallel=*/std::false_type) noexcept {
-    std::stable_sort(first, last, comp);
+void brick_sort(RandomAccessIterator first, RandomAccessIterator last, Compare comp, IsVector is_vector, /*is_stable=*/std::false_type) noexcept {
+    brick_sort(first, last, comp, is_vector);
 }
 
 template<class RandomAccessIterator, class Compare, class IsVector>
-void pattern_stable_sort(RandomAccessIterator first, RandomAccessIterator last, Compare comp, IsVector /*is_vector*/, /*is_parallel=*/std::true_type) {
+void brick_sort(RandomAccessIterator first, RandomAccessIterator last, Compare comp, IsVector is_vector, /*is_stable=*/std::true_type) noexcept {
+    brick_stable_sort(first, last, comp, is_vector);
+}
+
+template<class RandomAccessIterator, class Projection, class Compare, class IsStable, class IsVector>
+void pattern_sort_by_projection(RandomAccessIterator first, RandomAccessIterator last, Projection proj, Compare comp, IsStable is_stable, IsVector is_vector, /*is_parallel=*/std::false_type) noexcept {
+    brick_sort(first, last, projected_compare<Projection, Compare>(proj, comp), is_vector, is_stable);
+}
+
+//! Sort records by keys extracted once into a compact array, then move each record once to its place
+template<class RandomAccessIterator, class Projection, class Compare, class IsStable, class IsVector>
+void pattern_sort_by_projection(RandomAccessIterator first, RandomAccessIterator last, Projection proj, Compare comp, IsStable is_stable, IsVector is_vector, /*is_parallel=*/std::true_type) {
+    typedef typename std::iterator_traits<RandomAccessIterator>::value_type T;
+    typedef projection_item<typename projection_key<RandomAccessIterator, Projection>::type> item_type;
+    typedef projection_item_compare<Compare, IsStable> item_compare;
     except_handler([=]() {
-        par_backend::parallel_stable_sort(first, last, comp,
-            [](RandomAccessIterator first, RandomAccessIterator last, Compare comp) {
-            std::stable_sort(first, last, comp);
+        const std::size_t n = last - first;
+        par_backend::raw_buffer item_buf(n*sizeof(item_type));
+        par_backend::raw_buffer tmp_buf(n*sizeof(T));
+        if(!item_buf || !tmp_buf) {
+            // Out of memory - sort the records themselves
+            const projected_compare<Projection, Compare> record_comp(proj, comp);
+            invoke_if_else(is_stable,
+                [=]() { pattern_stable_sort(first, last, record_comp, is_vector, std::true_type()); },
+                [=]() { pattern_sort(first, last, record_comp, is_vector, std::true_type(), std::true_type()); });
+            return;
+        }
+        item_type* items = static_cast<item_type*>(item_buf.get());
+        T* tmp = static_cast<T*>(tmp_buf.get());
+        par_backend::parallel_for(std::size_t(0), n, [first, items, proj](std::size_t i, std::size_t j) {
+            for(; i != j; ++i)
+                new(items + i) item_type{proj(*(first + i)), i};
+        });
+        parallel_sample_sort(items, items + n, item_compare(comp),
+            [](item_type* first, item_type* last, item_compare comp) {
+            std::sort(first, last, comp);
+        });
+        par_backend::parallel_for(std::size_t(0), n, [first, items, tmp](std::size_t i, std::size_t j) {
+            for(; i != j; ++i) {
+                new(tmp + i) T(std::move(*(first + items[i].index)));
+                items[i].~item_type();
+            }
         });
+        par_backend::parallel_for(std::size_t(0), n, [first, tmp](std::size_t i, std::size_t j) {
+            for(; i != j; ++i) {
+                *(first + i) = std::move(tmp[i]);
+                tmp[i].~T();
+            }
+        });
+    });
+}
+
+//------------------------------------------------------------------------
+// histogram
+//
+// The element x is counted in bin key(x), unless key(x) is not less than
+// the number of bins. Few bins are counted by each thread into its own
+// histogram, and the histograms are added up. The bin numbers of many bins
+// are first scattered into partitions of consecutive bins, the way
+// parallel_sample_sort scatters elements into buckets, so that each
+// partition is counted by a single thread; key is then called twice for
+// each element.
+//------------------------------------------------------------------------
+
+//! Maximal number of bins that are counted into a histogram per thread
+const std::size_t HISTOGRAM_PRIVATE_MAX_BINS = 1<<14;
+//! Minimal number of elements counted into a histogram per thread, or partitioned by a block
+const std::size_t HISTOGRAM_MIN_BLOCK_SIZE = 1<<12;
+//! Maximal number of partitions of many bins
+const std::size_t HISTOGRAM_PARTITIONS = 256;
+//! Number of partitioned blocks per thread, for load balancing.
+const std::size_t HISTOGRAM_BLOCKS_PER_THREAD = 4;
+
+//! Add the number of elements in each bin to bins
+template<class InputIterator, class RandomAccessIterator, class KeyFunction>
+void brick_histogram(InputIterator first, InputIterator last, RandomAccessIterator bins, std::size_t nbins, KeyFunction key, /*is_vector=*/std::false_type) noexcept {
+    for(; first != last; ++first) {
+        const std::size_t b = std::size_t(key(*first));
+        if(b < nbins)
+            ++bins[b];
+    }
+}
+
+template<class InputIterator, class RandomAccessIterator, class KeyFunction>
+void brick_histogram(InputIterator first, InputIterator last, RandomAccessIterator bins, std::size_t nbins, KeyFunction key, /*is_vector=*/std::true_type) noexcept {
+    typedef typename std::iterator_traits<InputIterator>::difference_type difference_type;
+    if(nbins <= SIMD_HISTOGRAM_MAX_BINS)
+        simd_histogram(last - first, bins, nbins, [first, key](difference_type i) { return std::size_t(key(first[i])); });
+    else
+        brick_histogram(first, last, bins, nbins, key, std::false_type());
+}
+
+template<class InputIterator, class RandomAccessIterator, class KeyFunction, class IsVector>
+RandomAccessIterator pattern_histogram(InputIterator first, InputIterator last, RandomAccessIterator bins, std::size_t nbins, KeyFunction key, IsVector is_vector, /*is_parallel=*/std::false_type) noexcept {
+    typedef typename std::iterator_traits<RandomAccessIterator>::value_type count_type;
+    std::fill_n(bins, nbins, count_type(0));
+    brick_histogram(first, last, bins, nbins, key, is_vector);
+    return bins + nbins;
+}
+
+template<class RandomAccessIterator1, class RandomAccessIterator2, class KeyFunction, class IsVector>
+RandomAccessIterator2 pattern_histogram(RandomAccessIterator1 first, RandomAccessIterator1 last, RandomAccessIterator2 bins, std::size_t nbins, KeyFunction key, IsVector is_vector, /*is_parallel=*/std::true_type) {
+    typedef typename std::iterator_traits<RandomAccessIterator2>::value_type count_type;
+    return except_handler([=]() {
+        const std::size_t n = last - first;
+        if(nbins <= HISTOGRAM_PRIVATE_MAX_BINS) {
+            const std::size_t m = std::min<std::size_t>(n / HISTOGRAM_MIN_BLOCK_SIZE, par_backend::max_concurrency());
+            if(m > 1) {
+                par_backend::raw_buffer count_buf(sizeof(std::size_t)*m*nbins);
+                if(count_buf) {
+                    std::size_t* const count = static_cast<std::size_t*>(count_buf.get());
+                    const std::size_t block_size = (n-1)/m + 1;
+                    // Count the elements of each block into its own histogram
+                    par_backend::parallel_for(std::size_t(0), m, [=](std::size_t bi, std::size_t be) {
+                        for(; bi != be; ++bi) {
+                            std::size_t* const c = count + bi*nbins;
+                            std::fill(c, c + nbins, std::size_t(0));
+                            brick_histogram(first + bi*block_size, first + std::min(n, (bi+1)*block_size), c, nbins, key, is_vector);
+                        }
+                    });
+                    // Add up the histograms
+                    par_backend::parallel_for(std::size_t(0), nbins, [=](std::size_t b, std::size_t be) {
+                        for(std::size_t k = b; k != be; ++k)
+                            bins[k] = count_type(count[k]);
+                        for(std::size_t bi = 1; bi < m; ++bi) {
+                            const std::size_t* const c = count + bi*nbins;
+                            for(std::size_t k = b; k != be; ++k)
+                                bins[k] += count_type(c[k]);
+                        }
+                    });
+                    return bins + nbins;
+                }
+            }
+        }
+        else {
+            // The partitions are ranges of 2^shift bins
+            std::size_t shift = 0;
+            while( ((nbins-1) >> shift) >= HISTOGRAM_PARTITIONS )
+                ++shift;
+            const std::size_t k = ((nbins-1) >> shift) + 1;
+            const std::size_t p = par_backend::max_concurrency();
+            const std::size_t m = std::min<std::size_t>(n / HISTOGRAM_MIN_BLOCK_SIZE, HISTOGRAM_BLOCKS_PER_THREAD * p);
+            // The partitioning doubles the work, which does not pay off for a single thread
+            if(p > 1 && m > 1) {
+                par_backend::raw_buffer key_buf(sizeof(std::size_t)*n);
+                par_backend::raw_buffer count_buf(sizeof(std::size_t)*(m*k + k + 1));
+                if(key_buf && count_buf) {
+                    std::size_t* const keys = static_cast<std::size_t*>(key_buf.get());
+                    std::size_t* const count = static_cast<std::size_t*>(count_buf.get());
+                    std::size_t* const partition = count + m*k;
+                    const std::size_t block_size = (n-1)/m + 1;
+                    // Count the elements of each block in each partition
+                    par_backend::parallel_for(std::size_t(0), m, [=](std::size_t bi, std::size_t be) {
+                        for(; bi != be; ++bi) {
+                            std::size_t* const c = count + bi*k;
+                            std::fill(c, c + k, std::size_t(0));
+                            const std::size_t ie = std::min(n, (bi+1)*block_size);
+                            for(std::size_t i = bi*block_size; i < ie; ++i) {
+                                const std::size_t b = std::size_t(key(first[i]));
+                                if(b < nbins)
+                                    ++c[b >> shift];
+                            }
+                        }
+                    });
+                    // Turn counts into offsets of each block's portion of each partition
+                    std::size_t sum = 0;
+                    for(std::size_t p = 0; p < k; ++p) {
+                        partition[p] = sum;
+                        for(std::size_t bi = 0; bi < m; ++bi) {
+                            const std::size_t c = count[bi*k + p];
+                            count[bi*k + p] = sum;
+                            sum += c;
+                        }
+                    }
+                    partition[k] = sum;
+                    // Scatter the bin numbers into their partitions
+                    par_backend::parallel_for(std::size_t(0), m, [=](std::size_t bi, std::size_t be) {
+                        for(; bi != be; ++bi) {
+                            std::size_t* const c = count + bi*k;
+                            const std::size_t ie = std::min(n, (bi+1)*block_size);
+                            for(std::size_t i = bi*block_size; i < ie; ++i) {
+                                const std::size_t b = std::size_t(key(first[i]));
+                                if(b < nbins)
+                                    keys[c[b >> shift]++] = b;
+                            }
+                        }
+                    });
+                    // Count each partition into its own range of bins
+                    par_backend::parallel_for(std::size_t(0), k, [=](std::size_t p, std::size_t pe) {
+                        for(; p != pe; ++p) {
+                            std::fill(bins + (p << shift), bins + std::min(nbins, (p+1) << shift), count_type(0));
+                            for(std::size_t i = partition[p]; i < partition[p+1]; ++i)
+                                ++bins[keys[i]];
+                        }
+                    });
+                    return bins + nbins;
+                }
+            }
+        }
+        // Few elements or out of memory - use serial algorithm
+        return pattern_histogram(first, last, bins, nbins, key, is_vector, std::false_type());
     });
 }
 
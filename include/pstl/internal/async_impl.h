@@ -0,0 +1,164 @@
+/*
+    Copyright (c) 2017 Intel Corporation
+
+    Licensed under the Apache License, Version 2.0 (the "License");
+    you may not use this file except in compliance with the License.
+    You may obtain a copy of the License at
+
+        http://www.apache.org/licenses/LICENSE-2.0
+
+    Unless required by applicable law or agreed to in writing, software
+    distributed under the License is distributed on an "AS IS" BASIS,
+    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+    See the License for the specific language governing permissions and
+    limitations under the License.
+
+
+
+
+*/
+#ifndef __PSTL_async_impl_H
+#define __PSTL_async_impl_H
+
+#include <chrono>
+#include <exception>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "pstl_config.h"
+#include "algorithm_impl.h"
+
+namespace pstl {
+namespace internal {
+
+//! Start f() without waiting for it, on the threading backend if there is one
+template<typename F>
+void enqueue_async(const F& f) {
+#if __PSTL_USE_PAR_POLICIES
+    par_backend::enqueue(f);
+#else
+    std::thread(f).detach();
+#endif
+}
+
+template<typename T, typename F>
+void set_promise(std::promise<T>& promise, const F& f) {
+    promise.set_value(f());
+}
+
+template<typename F>
+void set_promise(std::promise<void>& promise, const F& f) {
+    f();
+    promise.set_value();
+}
+
+//! Result of an asynchronous algorithm, with the continuations to start when it is ready
+template<typename T>
+class async_state {
+    std::promise<T> my_promise;
+    std::shared_future<T> my_result;
+    std::mutex my_mutex;
+    bool my_ready;
+    std::vector<std::function<void()> > my_continuations;
+    async_state(const async_state&) = delete;
+    void operator=(const async_state&) = delete;
+public:
+    async_state(): my_result(my_promise.get_future().share()), my_ready(false) {}
+
+    //! Store the result of f(), or the exception it throws, and start the continuations
+    template<typename F>
+    void run(const F& f) {
+        try {
+            set_promise(my_promise, f);
+        }
+        catch(...) {
+            my_promise.set_exception(std::current_exception());
+        }
+        std::vector<std::function<void()> > continuations;
+        {
+            std::lock_guard<std::mutex> lock(my_mutex);
+            my_ready = true;
+            continuations.swap(my_continuations);
+        }
+        for( const std::function<void()>& continuation: continuations )
+            enqueue_async(continuation);
+    }
+
+    //! Start continuation when the result is ready, or now if it is
+    void add_continuation(const std::function<void()>& continuation) {
+        {
+            std::lock_guard<std::mutex> lock(my_mutex);
+            if( !my_ready ) {
+                my_continuations.push_back(continuation);
+                return;
+            }
+        }
+        enqueue_async(continuation);
+    }
+
+    const std::shared_future<T>& result() const { return my_result; }
+};
+
+} // namespace internal
+
+namespace async {
+
+//! Handle to the result of an asynchronous algorithm
+/** Like std::shared_future, it can be copied, and get() can be called more than once.
+    then() starts a follow-up computation when the result is ready, without blocking a thread to wait for it. */
+template<typename T>
+class future {
+    std::shared_ptr<internal::async_state<T> > my_state;
+public:
+    future() {}
+    explicit future(const std::shared_ptr<internal::async_state<T> >& state): my_state(state) {}
+
+    //! True if the future refers to an algorithm
+    bool valid() const { return bool(my_state); }
+    //! True if the result is ready, so that get() does not block
+    bool is_ready() const {
+        return my_state->result().wait_for(std::chrono::seconds(0)) == std::future_status::ready;
+    }
+    //! Wait until the result is ready
+    void wait() const { my_state->result().wait(); }
+    //! Wait until the result is ready and return it, or rethrow the exception of the algorithm
+    auto get() const -> decltype(std::declval<const std::shared_future<T>&>().get()) {
+        return my_state->result().get();
+    }
+
+    //! Future of f(*this), which starts on the threading backend when this future is ready
+    template<typename F>
+    future<typename std::result_of<F(future)>::type> then(F f) const {
+        typedef typename std::result_of<F(future)>::type result_type;
+        const std::shared_ptr<internal::async_state<result_type> > next = std::make_shared<internal::async_state<result_type> >();
+        const future self(*this);
+        my_state->add_continuation([next, self, f]() {
+            next->run([&self, &f]() { return f(self); });
+        });
+        return future<result_type>(next);
+    }
+};
+
+} // namespace async
+
+namespace internal {
+
+//! Start f() on the threading backend and return the future of its result
+template<typename F>
+async::future<typename std::result_of<F()>::type> async_invoke(const F& f) {
+    typedef typename std::result_of<F()>::type result_type;
+    const std::shared_ptr<async_state<result_type> > state = std::make_shared<async_state<result_type> >();
+    enqueue_async([state, f]() { state->run(f); });
+    return async::future<result_type>(state);
+}
+
+} // namespace internal
+} // namespace pstl
+
+#endif /* __PSTL_async_impl_H */
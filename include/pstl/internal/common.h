@@ -22,9 +22,46 @@
 #define __PSTL_common_H
 
 #include <new>
+#include <cmath>
 #include <iterator>
+#include <functional>
+#include <type_traits>
+
+#include "pstl_config.h"
+
+#if __PSTL_CPP14_INTEGER_SEQUENCE_PRESENT
+
+#include <utility>
+namespace pstl {
+    namespace internal {
+        using std::index_sequence;
+        using std::make_index_sequence;
+    } //internal
+}//namespace pstl
+
+#else //std::integer_sequence is not present
+namespace pstl {
+    namespace internal {
+template<std::size_t... S> class index_sequence {};
+template<std::size_t N, std::size_t... S>
+struct make_index_sequence_impl : make_index_sequence_impl < N - 1, N - 1, S... > {};
+template<std::size_t... S>
+struct make_index_sequence_impl <0, S...> {
+    typedef index_sequence<S...> type;
+};
+template<std::size_t N> struct make_index_sequence: internal::make_index_sequence_impl<N>::type {};
+} //internal
+}//namespace pstl
+#endif
 
 namespace pstl {
+
+template <typename IntType>
+class counting_iterator;
+
+template <typename... Types>
+class zip_iterator;
+
 namespace internal {
 
 template<typename F>
@@ -141,6 +178,142 @@ ForwardIterator cmp_iterators_by_values(ForwardIterator a, ForwardIterator b, Co
 }
 
 } // namespace internal
+
+//! Function object that returns the lesser of its arguments, the first one if they are equivalent
+/** Unlike a lambda that calls std::min, it is recognized by the vectorized scans and reductions. */
+template<typename T = void>
+struct minimum {
+    T operator()(const T& a, const T& b) const { return b < a ? b : a; }
+};
+
+template<>
+struct minimum<void> {
+    template<typename T>
+    T operator()(const T& a, const T& b) const { return b < a ? b : a; }
+};
+
+//! Function object that returns the greater of its arguments, the first one if they are equivalent
+/** Unlike a lambda that calls std::max, it is recognized by the vectorized scans and reductions. */
+template<typename T = void>
+struct maximum {
+    T operator()(const T& a, const T& b) const { return a < b ? b : a; }
+};
+
+template<>
+struct maximum<void> {
+    template<typename T>
+    T operator()(const T& a, const T& b) const { return a < b ? b : a; }
+};
+
+//! Function object that adds its arguments; reduce and transform_reduce with it compensate the rounding errors
+/** The reductions carry the rounding error of their floating-point sum alongside it, in each SIMD lane
+    and across the parallel subranges, and add it to the sum at the end (Neumaier's variant of Kahan
+    summation). The error of the result then hardly grows with the number of terms. For a sum in a
+    wider type, pass an initial value of that type, such as 0.0 for floats, with compensated_plus<double>
+    or std::plus<double>. Do not compile with -ffast-math, which removes the compensation. */
+template<typename T = void>
+struct compensated_plus {
+    T operator()(const T& a, const T& b) const { return a + b; }
+};
+
+template<>
+struct compensated_plus<void> {
+    template<typename T>
+    T operator()(const T& a, const T& b) const { return a + b; }
+};
+
+//! Whether the unsequenced reductions may combine values of type T with BinaryOperation in SIMD lanes
+/** The operation must be associative and commutative on the values, and have no side effects.
+    Specialize it as std::true_type to vectorize the reductions with an operation of your own. */
+template<typename BinaryOperation, typename T>
+struct is_vectorizable_reduction: std::false_type {};
+
+template<typename T>
+struct is_vectorizable_reduction<std::plus<T>, T>: std::is_arithmetic<T> {};
+
+template<typename T>
+struct is_vectorizable_reduction<std::multiplies<T>, T>: std::is_arithmetic<T> {};
+
+template<typename T>
+struct is_vectorizable_reduction<std::bit_and<T>, T>: std::is_integral<T> {};
+
+template<typename T>
+struct is_vectorizable_reduction<std::bit_or<T>, T>: std::is_integral<T> {};
+
+template<typename T>
+struct is_vectorizable_reduction<std::bit_xor<T>, T>: std::is_integral<T> {};
+
+template<typename T>
+struct is_vectorizable_reduction<minimum<T>, T>: std::is_arithmetic<T> {};
+
+template<typename T>
+struct is_vectorizable_reduction<maximum<T>, T>: std::is_arithmetic<T> {};
+
+template<typename T>
+struct is_vectorizable_reduction<minimum<void>, T>: std::is_arithmetic<T> {};
+
+template<typename T>
+struct is_vectorizable_reduction<maximum<void>, T>: std::is_arithmetic<T> {};
+
+#if __PSTL_CPP14_TRANSPARENT_COMPARATORS_PRESENT
+template<typename T>
+struct is_vectorizable_reduction<std::plus<void>, T>: std::is_arithmetic<T> {};
+
+template<typename T>
+struct is_vectorizable_reduction<std::multiplies<void>, T>: std::is_arithmetic<T> {};
+
+template<typename T>
+struct is_vectorizable_reduction<std::bit_and<void>, T>: std::is_integral<T> {};
+
+template<typename T>
+struct is_vectorizable_reduction<std::bit_or<void>, T>: std::is_integral<T> {};
+
+template<typename T>
+struct is_vectorizable_reduction<std::bit_xor<void>, T>: std::is_integral<T> {};
+#endif
+
+namespace internal {
+
+//! Add x to sum, and the rounding error of the addition to error (Neumaier)
+template<typename T>
+void compensated_add(T& sum, T& error, T x) noexcept {
+    const T t = sum + x;
+    error += std::abs(sum) >= std::abs(x) ? (sum - t) + x : (x - t) + sum;
+    sum = t;
+}
+
+//! Floating-point sum and the compensation of its rounding errors, which the reductions with compensated_plus compute
+template<typename T>
+struct compensated_sum {
+    T sum;
+    T error;
+};
+
+//! Combination of compensated sums
+template<typename T>
+struct compensated_sum_plus {
+    compensated_sum<T> operator()(compensated_sum<T> a, const compensated_sum<T>& b) const noexcept {
+        compensated_add(a.sum, a.error, b.sum);
+        a.error += b.error;
+        return a;
+    }
+};
+
+//! Operation that returns the result of op as a compensated sum without error
+template<typename T, typename Operation>
+struct compensated_sum_of {
+    Operation op;
+    template<typename... Args>
+    compensated_sum<T> operator()(Args&&... args) {
+        return compensated_sum<T>{T(op(std::forward<Args>(args)...)), T(0)};
+    }
+};
+
+} // namespace internal
+
+template<typename T>
+struct is_vectorizable_reduction<internal::compensated_sum_plus<T>, internal::compensated_sum<T> >: std::is_floating_point<T> {};
+
 } // namespace pstl
 
 #endif /* __PSTL_common_H */
@@ -94,6 +94,9 @@ struct policy_traits<parallel_unsequenced_policy> {
     typedef std::true_type allow_unsequenced;
     typedef std::true_type allow_vector;
 };
+
+template <class Policy>
+struct policy_traits<configured_policy<Policy> >: policy_traits<Policy> {};
 #endif
 
 template<class ExecPolicy, class T> using enable_if_execution_policy = typename std::enable_if<
@@ -126,6 +129,21 @@ decltype(lazy_and( exec.__allow_parallel(), typename is_random_access_iterator<i
     return lazy_and( exec.__allow_parallel(), typename is_random_access_iterator<iterator_types...>::type() );
 }
 
+//! True if the policy asks to initialize memory from the threads that later compute on it
+/** Such a policy has the algorithms that construct trivial objects without a value write them
+    anyway, so that each page is first touched from its NUMA node. */
+template<typename ExecutionPolicy>
+bool is_first_touch_preferred(const ExecutionPolicy&) {
+    return false;
+}
+
+#if __PSTL_USE_PAR_POLICIES
+template<typename Policy>
+bool is_first_touch_preferred(const configured_policy<Policy>& exec) {
+    return exec.__first_touch();
+}
+#endif
+
 template<typename policy, typename... iterator_types>
 struct prefer_unsequenced_tag {
     static constexpr bool value =
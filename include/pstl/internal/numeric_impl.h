@@ -24,12 +24,18 @@
 #include <iterator>
 #include <type_traits>
 #include <numeric>
+#include <tuple>
 #include "simd_impl.h"
 
 #include "execution_policy_impl.h"
+#include "algorithm_impl.h"
 
 #if __PSTL_USE_TBB
     #include "parallel_impl_tbb.h"
+#elif __PSTL_USE_OMP
+    #include "parallel_impl_omp.h"
+#elif __PSTL_USE_THREAD
+    #include "parallel_impl_thread.h"
 #else
     __PSTL_PRAGMA_MESSAGE("Backend was not specified");
 #endif
@@ -40,7 +46,7 @@ namespace internal {
 // transform_reduce (version with two binary functions, according to draft N4659)
 //------------------------------------------------------------------------
 
-template< class T, class BinaryOperation1, class IsArithmeticIsVector>
+template< class T, class BinaryOperation1, class IsVectorizable>
 struct brick_transform_reduce_imp {
 
     template<class InputIterator1, class InputIterator2, class BinaryOperation2>
@@ -57,8 +63,27 @@ struct brick_transform_reduce_imp {
     }
 };
 
+template< class T, class BinaryOperation1>
+struct brick_transform_reduce_imp<T, BinaryOperation1, /*IsVectorizable*/ std::true_type> {
+
+    template<class InputIterator1, class InputIterator2, class BinaryOperation2>
+    T operator()(InputIterator1 first1, InputIterator1 last1, InputIterator2 first2, T init, BinaryOperation1 binary_op1, BinaryOperation2 binary_op2) noexcept {
+        typedef typename std::iterator_traits<InputIterator1>::difference_type difference_type;
+        const auto x = simd_access(first1);
+        const auto y = simd_access(first2);
+        return simd_reduce(last1-first1, init, binary_op1, [x, y, binary_op2](difference_type i) mutable { return binary_op2(x[i], y[i]); });
+    }
+
+    template< class InputIterator, class UnaryOperation>
+    T operator()(InputIterator first, InputIterator last, T init, BinaryOperation1 binary_op, UnaryOperation unary_op) noexcept {
+        typedef typename std::iterator_traits<InputIterator>::difference_type difference_type;
+        const auto x = simd_access(first);
+        return simd_reduce(last-first, init, binary_op, [x, unary_op](difference_type i) mutable { return unary_op(x[i]); });
+    }
+};
+
 template< class T>
-struct brick_transform_reduce_imp<T, std::plus<T>, /*IsArithmeticIsVector*/ std::true_type> {
+struct brick_transform_reduce_imp<T, std::plus<T>, /*IsVectorizable*/ std::true_type> {
 
     template<class InputIterator1, class InputIterator2, class BinaryOperation2>
     T operator()(InputIterator1 first1, InputIterator1 last1, InputIterator2 first2, T init, std::plus<T>, BinaryOperation2 binary_op2) noexcept {
@@ -71,10 +96,28 @@ struct brick_transform_reduce_imp<T, std::plus<T>, /*IsArithmeticIsVector*/ std:
     }
 };
 
+template< class T>
+struct brick_transform_reduce_imp<compensated_sum<T>, compensated_sum_plus<T>, /*IsVectorizable*/ std::true_type> {
+
+    template<class InputIterator1, class InputIterator2, class BinaryOperation2>
+    compensated_sum<T> operator()(InputIterator1 first1, InputIterator1 last1, InputIterator2 first2, compensated_sum<T> init, compensated_sum_plus<T>, BinaryOperation2 binary_op2) noexcept {
+        typedef typename std::iterator_traits<InputIterator1>::difference_type difference_type;
+        simd_compensated_reduce(last1-first1, init.sum, init.error, [first1, first2, binary_op2](difference_type i) mutable { return binary_op2(first1[i], first2[i]).sum; });
+        return init;
+    }
+
+    template< class InputIterator, class UnaryOperation>
+    compensated_sum<T> operator()(InputIterator first, InputIterator last, compensated_sum<T> init, compensated_sum_plus<T>, UnaryOperation unary_op) noexcept {
+        typedef typename std::iterator_traits<InputIterator>::difference_type difference_type;
+        simd_compensated_reduce(last-first, init.sum, init.error, [first, unary_op](difference_type i) mutable { return unary_op(first[i]).sum; });
+        return init;
+    }
+};
+
 template<class InputIterator1, class InputIterator2, class T, class BinaryOperation1, class BinaryOperation2>
 T brick_transform_reduce(InputIterator1 first1, InputIterator1 last1, InputIterator2 first2, T init, BinaryOperation1 binary_op1, BinaryOperation2 binary_op2, /*is_vector=*/std::true_type) noexcept {
 
-    return brick_transform_reduce_imp< T, BinaryOperation1, std::integral_constant<bool, std::is_arithmetic<T>::value> >()(first1, last1, first2, init, binary_op1, binary_op2);
+    return brick_transform_reduce_imp< T, BinaryOperation1, std::integral_constant<bool, pstl::is_vectorizable_reduction<BinaryOperation1, T>::value> >()(first1, last1, first2, init, binary_op1, binary_op2);
 }
 
 template<class InputIterator1, class InputIterator2, class T, class BinaryOperation1, class BinaryOperation2>
@@ -102,13 +145,28 @@ T pattern_transform_reduce(InputIterator1 first1, InputIterator1 last1, InputIte
     });
 }
 
+// The reduction with compensated_plus runs over the compensated sums, whose error is added to the sum at the end
+template<class InputIterator1, class InputIterator2, class T, class U, class BinaryOperation2, class IsVector>
+T pattern_transform_reduce(InputIterator1 first1, InputIterator1 last1, InputIterator2 first2, T init, pstl::compensated_plus<U>, BinaryOperation2 binary_op2, IsVector is_vector, /*is_parallel=*/std::false_type) noexcept {
+    const compensated_sum<T> result = pattern_transform_reduce(first1, last1, first2, compensated_sum<T>{init, T(0)}, compensated_sum_plus<T>(),
+        compensated_sum_of<T, BinaryOperation2>{binary_op2}, is_vector, std::false_type());
+    return result.sum + result.error;
+}
+
+template<class InputIterator1, class InputIterator2, class T, class U, class BinaryOperation2, class IsVector>
+T pattern_transform_reduce(InputIterator1 first1, InputIterator1 last1, InputIterator2 first2, T init, pstl::compensated_plus<U>, BinaryOperation2 binary_op2, IsVector is_vector, /*is_parallel=*/std::true_type) noexcept {
+    const compensated_sum<T> result = pattern_transform_reduce(first1, last1, first2, compensated_sum<T>{init, T(0)}, compensated_sum_plus<T>(),
+        compensated_sum_of<T, BinaryOperation2>{binary_op2}, is_vector, std::true_type());
+    return result.sum + result.error;
+}
+
 //------------------------------------------------------------------------
 // transform_reduce (version with unary and binary functions)
 //------------------------------------------------------------------------
 
 template< class InputIterator, class T, class UnaryOperation, class BinaryOperation >
 T brick_transform_reduce(InputIterator first, InputIterator last, T init, BinaryOperation binary_op, UnaryOperation unary_op, /*is_vector=*/std::true_type) noexcept {
-    return brick_transform_reduce_imp< T, BinaryOperation, std::integral_constant<bool, std::is_arithmetic<T>::value> >()(first, last, init, binary_op, unary_op);
+    return brick_transform_reduce_imp< T, BinaryOperation, std::integral_constant<bool, pstl::is_vectorizable_reduction<BinaryOperation, T>::value> >()(first, last, init, binary_op, unary_op);
 }
 
 template< class InputIterator, class T, class BinaryOperation, class UnaryOperation >
@@ -135,6 +193,118 @@ T pattern_transform_reduce(InputIterator first, InputIterator last, T init, Bina
     });
 }
 
+template<class InputIterator, class T, class U, class UnaryOperation, class IsVector>
+T pattern_transform_reduce(InputIterator first, InputIterator last, T init, pstl::compensated_plus<U>, UnaryOperation unary_op, IsVector is_vector, /*is_parallel=*/std::false_type) noexcept {
+    const compensated_sum<T> result = pattern_transform_reduce(first, last, compensated_sum<T>{init, T(0)}, compensated_sum_plus<T>(),
+        compensated_sum_of<T, UnaryOperation>{unary_op}, is_vector, std::false_type());
+    return result.sum + result.error;
+}
+
+template<class InputIterator, class T, class U, class UnaryOperation, class IsVector>
+T pattern_transform_reduce(InputIterator first, InputIterator last, T init, pstl::compensated_plus<U>, UnaryOperation unary_op, IsVector is_vector, /*is_parallel=*/std::true_type) {
+    const compensated_sum<T> result = pattern_transform_reduce(first, last, compensated_sum<T>{init, T(0)}, compensated_sum_plus<T>(),
+        compensated_sum_of<T, UnaryOperation>{unary_op}, is_vector, std::true_type());
+    return result.sum + result.error;
+}
+
+//------------------------------------------------------------------------
+// transform_reduce of any number of ranges
+//
+// The iterators are indexed directly, instead of through a zip_iterator
+// whose dereference builds a tuple of references, so that the reduction
+// vectorizes like the one of a single range.
+//------------------------------------------------------------------------
+
+template<class DifferenceType, class T, class BinaryOperation, class NaryOperation, class... RandomAccessIterators>
+T brick_transform_reduce_n(DifferenceType n, T init, BinaryOperation binary_op, NaryOperation transform_op,
+                           /*is_vectorizable=*/std::false_type, RandomAccessIterators... firsts) noexcept {
+    for(DifferenceType i = 0; i < n; ++i)
+        init = binary_op(init, transform_op(firsts[i]...));
+    return init;
+}
+
+template<class DifferenceType, class T, class BinaryOperation, class NaryOperation, class... RandomAccessIterators>
+T brick_transform_reduce_n(DifferenceType n, T init, BinaryOperation binary_op, NaryOperation transform_op,
+                           /*is_vectorizable=*/std::true_type, RandomAccessIterators... firsts) noexcept {
+    return simd_reduce(n, init, binary_op, [=](DifferenceType i) mutable { return transform_op(firsts[i]...); });
+}
+
+template<class DifferenceType, class T, class BinaryOperation, class NaryOperation, class IsVector, class... RandomAccessIterators>
+T pattern_transform_reduce_n(DifferenceType n, T init, BinaryOperation binary_op, NaryOperation transform_op,
+                             IsVector, /*is_parallel=*/std::false_type, RandomAccessIterators... firsts) noexcept {
+    return brick_transform_reduce_n(n, init, binary_op, transform_op,
+        std::integral_constant<bool, IsVector::value && pstl::is_vectorizable_reduction<BinaryOperation, T>::value>(), firsts...);
+}
+
+template<class DifferenceType, class T, class BinaryOperation, class NaryOperation, class IsVector, class... RandomAccessIterators>
+T pattern_transform_reduce_n(DifferenceType n, T init, BinaryOperation binary_op, NaryOperation transform_op,
+                             IsVector, /*is_parallel=*/std::true_type, RandomAccessIterators... firsts) {
+    typedef std::integral_constant<bool, IsVector::value && pstl::is_vectorizable_reduction<BinaryOperation, T>::value> is_vectorizable;
+    return except_handler([=]() {
+        return par_backend::parallel_transform_reduce(DifferenceType(0), n,
+            [=](DifferenceType i) mutable { return transform_op(firsts[i]...); },
+            init,
+            binary_op,
+            [=](DifferenceType i, DifferenceType j, T init) {
+            return brick_transform_reduce_n(j - i, init, binary_op, transform_op, is_vectorizable(), (firsts + i)...);
+        });
+    });
+}
+
+//------------------------------------------------------------------------
+// multi_transform_reduce
+//
+// Several reductions of one range in a single pass. The vectorized form
+// reads the range in blocks that stay in cache, and reduces each block by
+// each reduction in turn, so that each takes its own vectorized brick.
+//------------------------------------------------------------------------
+
+//! Number of elements of the blocks that the vectorized multi_transform_reduce reduces by each reduction in turn
+const std::size_t MULTI_REDUCE_BLOCK_SIZE = 1<<10;
+
+template<class InputIterator, class Tuple, class Reductions, std::size_t... I>
+Tuple brick_multi_transform_reduce(InputIterator first, InputIterator last, Tuple sums, const Reductions& r,
+                                   /*is_vector=*/std::false_type, index_sequence<I...>) noexcept {
+    for(; first != last; ++first) {
+        int swallow[] = {0, (std::get<I>(sums) = std::get<I>(r).binary_op(std::get<I>(sums), std::get<I>(r).unary_op(*first)), 0)...};
+        (void)swallow;
+    }
+    return sums;
+}
+
+template<class InputIterator, class Tuple, class Reductions, std::size_t... I>
+Tuple brick_multi_transform_reduce(InputIterator first, InputIterator last, Tuple sums, const Reductions& r,
+                                   /*is_vector=*/std::true_type, index_sequence<I...>) noexcept {
+    typedef typename std::iterator_traits<InputIterator>::difference_type difference_type;
+    while(first != last) {
+        const InputIterator block_last = first + std::min(last - first, difference_type(MULTI_REDUCE_BLOCK_SIZE));
+        int swallow[] = {0, (std::get<I>(sums) = brick_transform_reduce(first, block_last, std::get<I>(sums),
+                                                                        std::get<I>(r).binary_op, std::get<I>(r).unary_op, std::true_type()), 0)...};
+        (void)swallow;
+        first = block_last;
+    }
+    return sums;
+}
+
+template<class Tuple, class InputIterator, class Reductions, class IsVector, std::size_t... I>
+Tuple pattern_multi_transform_reduce(InputIterator first, InputIterator last, const Reductions& r, IsVector is_vector,
+                                     /*is_parallel=*/std::false_type, index_sequence<I...> indices) noexcept {
+    return brick_multi_transform_reduce(first, last, Tuple(std::get<I>(r).init...), r, is_vector, indices);
+}
+
+template<class Tuple, class InputIterator, class Reductions, class IsVector, std::size_t... I>
+Tuple pattern_multi_transform_reduce(InputIterator first, InputIterator last, const Reductions& r, IsVector is_vector,
+                                     /*is_parallel=*/std::true_type, index_sequence<I...> indices) {
+    return except_handler([&]() {
+        return par_backend::parallel_transform_reduce(first, last,
+            [&r](InputIterator i) { return Tuple(std::get<I>(r).unary_op(*i)...); },
+            Tuple(std::get<I>(r).init...),
+            [&r](const Tuple& x, const Tuple& y) { return Tuple(std::get<I>(r).binary_op(std::get<I>(x), std::get<I>(y))...); },
+            [&r, is_vector, indices](InputIterator i, InputIterator j, Tuple init) {
+            return brick_multi_transform_reduce(i, j, init, r, is_vector, indices);
+        });
+    });
+}
 
 //------------------------------------------------------------------------
 // transform_exclusive_scan
@@ -162,9 +332,26 @@ std::pair<OutputIterator,T> brick_transform_scan(InputIterator first, InputItera
     return std::make_pair(result,init);
 }
 
+template<class InputIterator, class OutputIterator, class UnaryOperation, class T, class BinaryOperation, class Inclusive>
+std::pair<OutputIterator,T> brick_transform_scan_imp(InputIterator first, InputIterator last, OutputIterator result, UnaryOperation unary_op, T init, BinaryOperation binary_op, Inclusive, /*is_simd=*/std::false_type) noexcept {
+    return brick_transform_scan(first, last, result, unary_op, init, binary_op, Inclusive());
+}
+
+template<class InputIterator, class OutputIterator, class UnaryOperation, class T, class BinaryOperation, class Inclusive>
+std::pair<OutputIterator,T> brick_transform_scan_imp(InputIterator first, InputIterator last, OutputIterator result, UnaryOperation unary_op, T init, BinaryOperation binary_op, Inclusive, /*is_simd=*/std::true_type) noexcept {
+    return simd_scan(first, last-first, result, unary_op, init, binary_op, Inclusive());
+}
+
+// Vectorized form; the scans of arithmetic values with std::plus, pstl::minimum and pstl::maximum are computed in registers
+template<class InputIterator, class OutputIterator, class UnaryOperation, class T, class BinaryOperation, class Inclusive, class IsVector>
+std::pair<OutputIterator,T> brick_transform_scan(InputIterator first, InputIterator last, OutputIterator result, UnaryOperation unary_op, T init, BinaryOperation binary_op, Inclusive, IsVector) noexcept {
+    return brick_transform_scan_imp(first, last, result, unary_op, init, binary_op, Inclusive(),
+        std::integral_constant<bool, IsVector::value && is_simd_scan_operation<BinaryOperation, T>::value>());
+}
+
 template<class InputIterator, class OutputIterator, class UnaryOperation, class T, class BinaryOperation, class Inclusive, class IsVector>
 OutputIterator pattern_transform_scan(InputIterator first, InputIterator last, OutputIterator result, UnaryOperation unary_op, T init, BinaryOperation binary_op, Inclusive, IsVector is_vector, /*is_parallel=*/std::false_type ) noexcept {
-    return brick_transform_scan(first, last, result, unary_op, init, binary_op, Inclusive()).first;
+    return brick_transform_scan(first, last, result, unary_op, init, binary_op, Inclusive(), is_vector).first;
 }
 
 template<class InputIterator, class OutputIterator, class UnaryOperation, class T, class BinaryOperation, class Inclusive, class IsVector>
@@ -180,13 +367,215 @@ OutputIterator pattern_transform_scan(InputIterator first, InputIterator last, O
             [first, unary_op, binary_op, is_vector](difference_type i, difference_type j, T init) {
             return brick_transform_reduce(first+i, first+j, init, binary_op, unary_op, is_vector);
         },
-        [first, unary_op, binary_op, result](difference_type i, difference_type j, T init) {
-        return brick_transform_scan(first+i, first+j, result+i, unary_op, init, binary_op, Inclusive()).second;
+        [first, unary_op, binary_op, result, is_vector](difference_type i, difference_type j, T init) {
+        return brick_transform_scan(first+i, first+j, result+i, unary_op, init, binary_op, Inclusive(), is_vector).second;
         });
         return result+(last-first);
     });
 }
 
+//------------------------------------------------------------------------
+// reduce_by_key, inclusive_scan_by_key, exclusive_scan_by_key
+//
+// A segment is a run of consecutive equal keys; its head is its first
+// element. The parallel forms flag the heads of the keys the way
+// unique_copy does, and compute a strict scan of segment_sum values.
+//------------------------------------------------------------------------
+
+//! Number of heads in a range of values, and the reduction of its last segment
+template<typename DifferenceType, typename T>
+struct segment_sum {
+    DifferenceType heads;
+    T sum;
+};
+
+//! Combination of segment sums; the sum of a range that has heads does not depend on the ranges before it
+template<typename DifferenceType, typename T, typename BinaryOperation>
+struct segment_sum_plus {
+    BinaryOperation op;
+    segment_sum<DifferenceType, T> operator()(const segment_sum<DifferenceType, T>& a, const segment_sum<DifferenceType, T>& b) const {
+        return b.heads ? segment_sum<DifferenceType, T>{a.heads + b.heads, b.sum} : segment_sum<DifferenceType, T>{a.heads, op(a.sum, b.sum)};
+    }
+};
+
+//! End of the segment of keys that starts at first, with first!=last
+template<class InputIterator, class BinaryPredicate>
+InputIterator brick_segment_end(InputIterator first, InputIterator last, BinaryPredicate pred) noexcept {
+    InputIterator previous = first;
+    while( ++first != last && pred(*first, *previous) )
+        previous = first;
+    return first;
+}
+
+//! Position of the first head in [k,n) according to mask, or n
+template<class DifferenceType>
+DifferenceType next_head(const bool* mask, DifferenceType k, DifferenceType n) noexcept {
+    return std::find(mask + k, mask + n, true) - mask;
+}
+
+//! Flag the heads of the segments of keys [0,n) into mask and return their number and the reduction of the last segment
+/** The element before the range is known, unless first is true. The reduction of a segment starts with its
+    head in the inclusive form, and with init in the exclusive form, which applies to the segments with a head only. */
+template<class DifferenceType, class T, class InputIterator1, class InputIterator2, class BinaryPredicate, class BinaryOperation, class Inclusive, class IsVector>
+segment_sum<DifferenceType, T> brick_segment_reduce(InputIterator1 keys, InputIterator2 values, DifferenceType n, bool first, bool* mask,
+                                                    BinaryPredicate pred, BinaryOperation op, const T& init, Inclusive, IsVector is_vector) noexcept {
+    DifferenceType heads = 0;
+    if( first ) {
+        mask[0] = true;
+        heads = 1;
+    }
+    heads += brick_calc_mask_2<DifferenceType>(keys + heads, keys + n, mask + heads, pred, is_vector);
+    DifferenceType k = n;
+    while( k > 0 && !mask[k - 1] )
+        --k;
+    if( k == 0 )
+        return segment_sum<DifferenceType, T>{heads, brick_transform_reduce(values + 1, values + n, T(values[0]), op, no_op(), is_vector)};
+    if( Inclusive::value )
+        return segment_sum<DifferenceType, T>{heads, brick_transform_reduce(values + k, values + n, T(values[k - 1]), op, no_op(), is_vector)};
+    return segment_sum<DifferenceType, T>{heads, brick_transform_reduce(values + (k - 1), values + n, init, op, no_op(), is_vector)};
+}
+
+template<class InputIterator1, class InputIterator2, class OutputIterator1, class OutputIterator2, class BinaryPredicate, class BinaryOperation, class IsVector>
+std::pair<OutputIterator1, OutputIterator2> brick_reduce_by_key(InputIterator1 keys_first, InputIterator1 keys_last, InputIterator2 values_first,
+                                                                OutputIterator1 keys_result, OutputIterator2 values_result,
+                                                                BinaryPredicate pred, BinaryOperation op, IsVector is_vector) noexcept {
+    typedef typename std::iterator_traits<InputIterator2>::value_type T;
+    while( keys_first != keys_last ) {
+        const InputIterator1 keys_end = brick_segment_end(keys_first, keys_last, pred);
+        const InputIterator2 values_end = std::next(values_first, std::distance(keys_first, keys_end));
+        *keys_result = *keys_first;
+        *values_result = brick_transform_reduce(std::next(values_first), values_end, T(*values_first), op, no_op(), is_vector);
+        ++keys_result;
+        ++values_result;
+        keys_first = keys_end;
+        values_first = values_end;
+    }
+    return std::make_pair(keys_result, values_result);
+}
+
+template<class InputIterator1, class InputIterator2, class OutputIterator1, class OutputIterator2, class BinaryPredicate, class BinaryOperation, class IsVector>
+std::pair<OutputIterator1, OutputIterator2> pattern_reduce_by_key(InputIterator1 keys_first, InputIterator1 keys_last, InputIterator2 values_first,
+                                                                  OutputIterator1 keys_result, OutputIterator2 values_result,
+                                                                  BinaryPredicate pred, BinaryOperation op, IsVector is_vector, /*is_parallel=*/std::false_type) noexcept {
+    return brick_reduce_by_key(keys_first, keys_last, values_first, keys_result, values_result, pred, op, is_vector);
+}
+
+template<class InputIterator1, class InputIterator2, class OutputIterator1, class OutputIterator2, class BinaryPredicate, class BinaryOperation, class IsVector>
+std::pair<OutputIterator1, OutputIterator2> pattern_reduce_by_key(InputIterator1 keys_first, InputIterator1 keys_last, InputIterator2 values_first,
+                                                                  OutputIterator1 keys_result, OutputIterator2 values_result,
+                                                                  BinaryPredicate pred, BinaryOperation op, IsVector is_vector, /*is_parallel=*/std::true_type) {
+    typedef typename std::iterator_traits<InputIterator1>::difference_type difference_type;
+    typedef typename std::iterator_traits<InputIterator2>::value_type T;
+    typedef segment_sum<difference_type, T> sum_type;
+    const difference_type n = keys_last - keys_first;
+    // The segment sums are kept in raw memory by the strict scan
+    if( difference_type(2) < n && std::is_trivially_copyable<T>::value ) {
+        par_backend::raw_buffer mask_buf(n*sizeof(bool));
+        if( mask_buf ) {
+            return except_handler([n, keys_first, values_first, keys_result, values_result, pred, op, is_vector, &mask_buf]() {
+                bool* mask = static_cast<bool*>(mask_buf.get());
+                difference_type m;
+                par_backend::parallel_strict_scan(n, sum_type{0, T(values_first[0])},
+                    [=](difference_type i, difference_type len) {                                // Reduce
+                        return brick_segment_reduce(keys_first + i, values_first + i, len, i == 0, mask + i, pred, op, T(), std::true_type(), is_vector);
+                    },
+                    segment_sum_plus<difference_type, T, BinaryOperation>{op},                     // Combine
+                    [=](difference_type i, difference_type len, sum_type initial) {               // Scan
+                        // Write the key of each head, and the sum of each segment that ends in the subrange
+                        difference_type segment = initial.heads - 1;
+                        T sum = initial.sum;
+                        for( difference_type k = 0; k < len; ) {
+                            difference_type start = k;
+                            if( mask[i + k] ) {
+                                ++segment;
+                                keys_result[segment] = keys_first[i + k];
+                                sum = values_first[i + k];
+                                ++start;
+                            }
+                            k = next_head(mask + i, k + 1, len);
+                            sum = brick_transform_reduce(values_first + (i + start), values_first + (i + k), sum, op, no_op(), is_vector);
+                            // The mask of the next subrange may not be computed yet
+                            if( k < len || i + len == n || !pred(keys_first[i + len], keys_first[i + len - 1]) )
+                                values_result[segment] = sum;
+                        }
+                    },
+                    [&m](sum_type total) { m = total.heads; });
+                return std::make_pair(keys_result + m, values_result + m);
+            });
+        }
+    }
+    // Out of memory, trivial sequence or non-trivial values - use serial algorithm
+    return brick_reduce_by_key(keys_first, keys_last, values_first, keys_result, values_result, pred, op, is_vector);
+}
+
+template<class InputIterator1, class InputIterator2, class OutputIterator, class T, class BinaryPredicate, class BinaryOperation, class Inclusive, class IsVector>
+OutputIterator brick_scan_by_key(InputIterator1 keys_first, InputIterator1 keys_last, InputIterator2 values_first, OutputIterator result,
+                                 T init, BinaryPredicate pred, BinaryOperation op, Inclusive, IsVector is_vector) noexcept {
+    while( keys_first != keys_last ) {
+        const InputIterator1 keys_end = brick_segment_end(keys_first, keys_last, pred);
+        const InputIterator2 values_end = std::next(values_first, std::distance(keys_first, keys_end));
+        if( Inclusive::value ) {
+            const T head = *values_first;
+            *result = head;
+            result = brick_transform_scan(std::next(values_first), values_end, std::next(result), no_op(), head, op, Inclusive(), is_vector).first;
+        }
+        else
+            result = brick_transform_scan(values_first, values_end, result, no_op(), init, op, Inclusive(), is_vector).first;
+        keys_first = keys_end;
+        values_first = values_end;
+    }
+    return result;
+}
+
+template<class InputIterator1, class InputIterator2, class OutputIterator, class T, class BinaryPredicate, class BinaryOperation, class Inclusive, class IsVector>
+OutputIterator pattern_scan_by_key(InputIterator1 keys_first, InputIterator1 keys_last, InputIterator2 values_first, OutputIterator result,
+                                   T init, BinaryPredicate pred, BinaryOperation op, Inclusive, IsVector is_vector, /*is_parallel=*/std::false_type) noexcept {
+    return brick_scan_by_key(keys_first, keys_last, values_first, result, init, pred, op, Inclusive(), is_vector);
+}
+
+template<class InputIterator1, class InputIterator2, class OutputIterator, class T, class BinaryPredicate, class BinaryOperation, class Inclusive, class IsVector>
+OutputIterator pattern_scan_by_key(InputIterator1 keys_first, InputIterator1 keys_last, InputIterator2 values_first, OutputIterator result,
+                                   T init, BinaryPredicate pred, BinaryOperation op, Inclusive, IsVector is_vector, /*is_parallel=*/std::true_type) {
+    typedef typename std::iterator_traits<InputIterator1>::difference_type difference_type;
+    typedef segment_sum<difference_type, T> sum_type;
+    const difference_type n = keys_last - keys_first;
+    // The segment sums are kept in raw memory by the strict scan
+    if( difference_type(2) < n && std::is_trivially_copyable<T>::value ) {
+        par_backend::raw_buffer mask_buf(n*sizeof(bool));
+        if( mask_buf ) {
+            return except_handler([n, keys_first, values_first, result, init, pred, op, is_vector, &mask_buf]() {
+                bool* mask = static_cast<bool*>(mask_buf.get());
+                par_backend::parallel_strict_scan(n, sum_type{0, init},
+                    [=](difference_type i, difference_type len) {                                // Reduce
+                        return brick_segment_reduce(keys_first + i, values_first + i, len, i == 0, mask + i, pred, op, init, Inclusive(), is_vector);
+                    },
+                    segment_sum_plus<difference_type, T, BinaryOperation>{op},                     // Combine
+                    [=](difference_type i, difference_type len, sum_type initial) {               // Scan
+                        // Scan each segment of the subrange, starting from the sum of the segment before it if it has no head
+                        T sum = initial.sum;
+                        for( difference_type k = 0; k < len; ) {
+                            difference_type start = k;
+                            if( mask[i + k] ) {
+                                if( Inclusive::value ) {
+                                    sum = values_first[i + k];
+                                    result[i + k] = sum;
+                                    ++start;
+                                }
+                                else
+                                    sum = init;
+                            }
+                            k = next_head(mask + i, k + 1, len);
+                            sum = brick_transform_scan(values_first + (i + start), values_first + (i + k), result + (i + start), no_op(), sum, op, Inclusive(), is_vector).second;
+                        }
+                    },
+                    [](sum_type) {});
+                return result + n;
+            });
+        }
+    }
+    // Out of memory, trivial sequence or non-trivial values - use serial algorithm
+    return brick_scan_by_key(keys_first, keys_last, values_first, result, init, pred, op, Inclusive(), is_vector);
+}
 
 //------------------------------------------------------------------------
 // adjacent_difference
@@ -0,0 +1,543 @@
+/*
+    Copyright (c) 2017 Intel Corporation
+
+    Licensed under the Apache License, Version 2.0 (the "License");
+    you may not use this file except in compliance with the License.
+    You may obtain a copy of the License at
+
+        http://www.apache.org/licenses/LICENSE-2.0
+
+    Unless required by applicable law or agreed to in writing, software
+    distributed under the License is distributed on an "AS IS" BASIS,
+    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+    See the License for the specific language governing permissions and
+    limitations under the License.
+
+
+
+
+*/
+
+#ifndef __PSTL_parallel_backend_fork_join_H
+#define __PSTL_parallel_backend_fork_join_H
+
+#include <atomic>
+#include <algorithm>
+#include <cstdint>
+#include <exception>
+#include <iterator>
+#include <thread>
+#include <vector>
+// This header implements the parallel routines required to support Parallel STL
+// with recursive fork-join parallelism. It is included by the backends whose
+// schedulers only provide the following primitives, which must be declared first:
+//     max_concurrency() -- return the number of threads that execute the tasks.
+//     execute_root(f) -- execute f() on the threads of the scheduler and wait for it.
+//     invoke_tasks(context, f1, f2) -- execute context.run(f1) and context.run(f2), possibly in parallel, and wait for both.
+
+#include "parallel_backend_utils.h"
+#include "parallel_settings.h"
+
+namespace pstl {
+namespace par_backend {
+
+//! Number of subranges per thread a range is split into, for load balancing.
+const size_t FORK_JOIN_TASKS_PER_THREAD = 8;
+
+//! Size of the subranges of a range of n elements; none is split below grainsize elements.
+/** The policy of the algorithm may ask for chunks of at least a given size, and for one chunk per thread. */
+inline size_t fork_join_grainsize(size_t n, size_t grainsize = 1) {
+    grainsize = std::max(grainsize, internal::policy_grainsize());
+    if( internal::static_partitioning() )
+        return std::max(grainsize, (n + max_concurrency() - 1)/max_concurrency());
+    if( internal::policy_grainsize() )
+        return grainsize;
+    return std::max(grainsize, n/(FORK_JOIN_TASKS_PER_THREAD*max_concurrency()));
+}
+
+//! Size of the blocks of a reduction or scan of n elements
+/** A reproducible one has blocks of a fixed size, whatever the number of threads. */
+inline size_t fork_join_blocksize(size_t n) {
+    return internal::reproducible() ? internal::reproducible_blocksize() : fork_join_grainsize(n);
+}
+
+//! State shared by the tasks of one parallel algorithm
+/** Keeps the cancellation flag and the first exception thrown by a task,
+    which is rethrown to the caller of the algorithm after all tasks are joined. */
+class task_context {
+    std::atomic<bool> my_cancelled;
+    std::atomic<bool> my_failed;
+    std::exception_ptr my_exception;
+    task_context(const task_context&) = delete;
+    void operator=(const task_context&) = delete;
+public:
+    task_context(): my_cancelled(false), my_failed(false) {}
+    //! The context of the task being executed by the calling thread, or NULL
+    static task_context*& current() {
+        static thread_local task_context* context = NULL;
+        return context;
+    }
+    void cancel() { my_cancelled.store(true, std::memory_order_relaxed); }
+    bool is_cancelled() const { return my_cancelled.load(std::memory_order_relaxed); }
+    //! Execute f() unless the context was cancelled; an exception cancels the context.
+    template<typename F>
+    void run(const F& f) {
+        if( is_cancelled() )
+            return;
+        task_context*& context = current();
+        task_context* const outer = context;
+        context = this;
+        try {
+            f();
+        }
+        catch(...) {
+            if( !my_failed.exchange(true) )
+                my_exception = std::current_exception();
+            cancel();
+        }
+        context = outer;
+    }
+    //! Rethrow the first exception thrown by a task, if any
+    void rethrow() const {
+        if( my_exception )
+            std::rethrow_exception(my_exception);
+    }
+};
+
+//! Storage for a value that a cancelled task may not have computed
+template<typename T>
+class task_result {
+    alignas(T) char my_storage[sizeof(T)];
+    bool my_has_value;
+    task_result(const task_result&) = delete;
+    void operator=(const task_result&) = delete;
+public:
+    task_result(): my_has_value(false) {}
+    ~task_result() {
+        if( my_has_value )
+            get().~T();
+    }
+    void set(T value) {
+        if( my_has_value )
+            get() = std::move(value);
+        else {
+            new(my_storage) T(std::move(value));
+            my_has_value = true;
+        }
+    }
+    explicit operator bool() const { return my_has_value; }
+    T& get() { return *reinterpret_cast<T*>(my_storage); }
+};
+
+inline void cancel_execution() {
+    if( task_context* context = task_context::current() )
+        context->cancel();
+}
+
+//! Make no context current for the calling thread while in scope
+/** A body that runs serially, outside of any task, then cannot cancel the algorithm that encloses its own. */
+class serial_scope {
+    task_context* const my_saved;
+    serial_scope(const serial_scope&) = delete;
+    void operator=(const serial_scope&) = delete;
+public:
+    serial_scope(): my_saved(task_context::current()) {
+        task_context::current() = NULL;
+    }
+    ~serial_scope() { task_context::current() = my_saved; }
+};
+
+//! Execute f(context) as the root task of an algorithm and rethrow the exception of any of its tasks
+template<typename F>
+void fork_join_execute(F f) {
+    task_context context;
+    execute_root([&context, &f]() {
+        context.run([&context, &f]() { f(context); });
+    });
+    context.rethrow();
+}
+
+//------------------------------------------------------------------------
+// parallel_for
+//------------------------------------------------------------------------
+
+template<class Index, class F>
+void fork_join_for(Index first, Index last, size_t grainsize, task_context& context, F f) {
+    if( size_t(last - first) <= grainsize )
+        f(first, last);
+    else {
+        const Index middle = first + (last - first)/2;
+        invoke_tasks(context,
+            [&]() { fork_join_for(first, middle, grainsize, context, f); },
+            [&]() { fork_join_for(middle, last, grainsize, context, f); });
+    }
+}
+
+//! Evaluation of brick f[i,j) for each subrange [i,j) of [first,last)
+template<class Index, class F>
+void parallel_for(Index first, Index last, F f) {
+    if( run_serial_head(first, last, max_concurrency(), [&f](Index i, Index j) { serial_scope scope; f(i, j); }) || first == last )
+        return;
+    const size_t grainsize = fork_join_grainsize(last - first);
+    fork_join_execute([first, last, grainsize, &f](task_context& context) {
+        fork_join_for(first, last, grainsize, context, f);
+    });
+}
+
+//------------------------------------------------------------------------
+// parallel_reduce
+//------------------------------------------------------------------------
+
+template<class Value, class Index, typename RealBody, typename Reduction>
+Value fork_join_reduce(Index first, Index last, const Value& identity, const RealBody& real_body, const Reduction& reduction, size_t grainsize, task_context& context) {
+    if( size_t(last - first) <= grainsize )
+        return real_body(first, last, identity);
+    const Index middle = first + (last - first)/2;
+    // A subrange skipped by cancellation contributes the identity
+    Value left(identity), right(identity);
+    invoke_tasks(context,
+        [&]() { left = fork_join_reduce(first, middle, identity, real_body, reduction, grainsize, context); },
+        [&]() { right = fork_join_reduce(middle, last, identity, real_body, reduction, grainsize, context); });
+    return reduction(left, right);
+}
+
+//! Evaluation of brick f[i,j) for each subrange [i,j) of [first,last)
+template<class Value, class Index, typename RealBody, typename Reduction>
+Value parallel_reduce(Index first, Index last, const Value& identity, const RealBody& real_body, const Reduction& reduction, std::size_t grainsize = 1) {
+    const Index begin = first;
+    Value head(identity);
+    if( run_serial_head(first, last, max_concurrency(), [&](Index i, Index j) { serial_scope scope; head = real_body(i, j, head); }) )
+        return head;
+    Value result(identity);
+    if( first != last ) {
+        grainsize = fork_join_grainsize(last - first, grainsize);
+        fork_join_execute([&](task_context& context) {
+            result = fork_join_reduce(first, last, identity, real_body, reduction, grainsize, context);
+        });
+    }
+    // The serial head, if any, precedes the rest of the range
+    return first != begin ? reduction(head, result) : result;
+}
+
+//------------------------------------------------------------------------
+// parallel_transform_reduce
+//
+// Notation:
+//      r(i,j,init) returns reduction of init with reduction over [i,j)
+//      u(i) returns f(i,i+1,identity) for a hypothetical left identity element of r
+//      c(x,y) combines values x and y that were the result of r or u
+//------------------------------------------------------------------------
+
+template<class Index, class U, class T, class C, class R>
+void fork_join_transform_reduce(Index first, Index last, U u, C combine, R brick_reduce, size_t grainsize, task_context& context, task_result<T>& sum) {
+    if( size_t(last - first) <= grainsize )
+        sum.set(brick_reduce(first + 1, last, u(first)));
+    else {
+        const Index middle = first + (last - first)/2;
+        task_result<T> right;
+        invoke_tasks(context,
+            [&]() { fork_join_transform_reduce(first, middle, u, combine, brick_reduce, grainsize, context, sum); },
+            [&]() { fork_join_transform_reduce(middle, last, u, combine, brick_reduce, grainsize, context, right); });
+        if( sum && right )
+            sum.set(combine(sum.get(), right.get()));
+    }
+}
+
+template<class Index, class U, class T, class C, class R>
+T parallel_transform_reduce( Index first, Index last, U u, T init, C combine, R brick_reduce) {
+    if( run_serial_head(first, last, max_concurrency(), [&](Index i, Index j) { serial_scope scope; init = brick_reduce(i, j, init); }) || first == last )
+        return init;
+    task_result<T> sum;
+    const size_t grainsize = fork_join_blocksize(last - first);
+    fork_join_execute([&](task_context& context) {
+        fork_join_transform_reduce(first, last, u, combine, brick_reduce, grainsize, context, sum);
+    });
+    return combine(init, sum.get());
+}
+
+//------------------------------------------------------------------------
+// parallel_scan
+//
+// The range is split into tiles that are scanned in a single pass, each
+// right after its reduction, when their sums can be published. Otherwise
+// the tiles but the last are reduced in parallel, the prefix sums of the
+// tiles are computed serially, then the tiles are scanned in parallel.
+//------------------------------------------------------------------------
+
+//! Run the chained scan of tiles with one task per thread
+template<typename T, typename R, typename C, typename S>
+void fork_join_chained_scan(chained_scan<T>& tiles, const T& initial, R reduce, C combine, S scan) {
+    const size_t p = std::min(max_concurrency(), tiles.size());
+    fork_join_execute([&](task_context& context) {
+        fork_join_for(size_t(0), p, 1, context, [&](size_t i, size_t j) {
+            for( ; i != j; ++i )
+                tiles.run(initial, reduce, combine, scan);
+        });
+    });
+}
+
+template<class Index, class U, class T, class C, class R, class S>
+T parallel_transform_scan(Index n, U u, T init, C combine, R brick_reduce, S scan) {
+    if( !n )
+        return init;
+    const size_t tilesize = fork_join_blocksize(n);
+    const size_t m = (n - 1)/tilesize + 1;
+    if( m == 1 || size_t(n) < internal::policy_serial_cutoff() )
+        return scan(Index(0), n, init);
+    if( is_chained_scan_value<T>::value ) {
+        chained_scan<T> tiles(n, chained_scan_tilesize(n, max_concurrency()), internal::reproducible());
+        if( tiles ) {
+            fork_join_chained_scan(tiles, init,
+                [u, brick_reduce](size_t i, size_t j) mutable { return brick_reduce(Index(i + 1), Index(j), u(Index(i))); },
+                combine,
+                [scan](size_t i, size_t j, const T& prefix) mutable { scan(Index(i), Index(j), prefix); });
+            return tiles.total();
+        }
+    }
+    // sum[i] is the reduction of init with tiles [0,i]
+    std::vector<task_result<T>> sum(m);
+    task_result<T> total;
+    fork_join_execute([&](task_context& context) {
+        fork_join_for(size_t(0), m - 1, 1, context, [&sum, tilesize, u, brick_reduce](size_t i, size_t j) mutable {
+            for( ; i != j; ++i ) {
+                const Index k = Index(i*tilesize);
+                sum[i].set(brick_reduce(k + 1, Index(k + tilesize), u(k)));
+            }
+        });
+        if( context.is_cancelled() )
+            return;
+        sum[0].set(combine(init, sum[0].get()));
+        for( size_t i = 1; i < m - 1; ++i )
+            sum[i].set(combine(sum[i-1].get(), sum[i].get()));
+        fork_join_for(size_t(0), m, 1, context, [&sum, &total, &init, n, m, tilesize, scan](size_t i, size_t j) mutable {
+            for( ; i != j; ++i ) {
+                const Index k = Index(i*tilesize);
+                const Index e = i == m - 1 ? n : Index(k + tilesize);
+                if( i == m - 1 )
+                    total.set(scan(k, e, i ? sum[i-1].get() : init));
+                else
+                    scan(k, e, i ? sum[i-1].get() : init);
+            }
+        });
+    });
+    return total.get();
+}
+
+//------------------------------------------------------------------------
+// parallel_strict_scan
+//------------------------------------------------------------------------
+
+// Let i:len denote a counted interval of length n starting at i.  s denotes a generalized-sum value.
+// Expected actions of the functors are:
+//     reduce(i,len) -> s  -- return reduction value of i:len.
+//     combine(s1,s2) -> s -- return merged sum
+//     apex(s) -- do any processing necessary between reduce and scan.
+//     scan(i,len,initial) -- perform scan over i:len starting with initial.
+// The initial range 0:n is partitioned into consecutive subranges.
+// reduce and scan are each called exactly once per subrange.
+// Thus callers can rely upon side effects in reduce.
+// combine must not throw an exception.
+// apex is called exactly once, after all calls to reduce, with the combination of initial and all reduction values.
+// The tiles are scanned in a single pass, each right after its reduction, so apex may be called after the calls to scan,
+// which must not depend on it.
+// T must have a trivial constructor and destructor.
+template<typename Index, typename T, typename R, typename C, typename S, typename A>
+void parallel_strict_scan( Index n, T initial, R reduce, C combine, S scan, A apex ) {
+    // Below the serial cutoff of the policy the sequence is a single block too
+    if( n>1 && size_t(n) >= internal::policy_serial_cutoff() ) {
+        chained_scan<T> tiles(n, chained_scan_tilesize(n, max_concurrency()), internal::reproducible());
+        if( tiles.size()>1 && tiles ) {
+            fork_join_chained_scan(tiles, initial,
+                [reduce](size_t i, size_t j) mutable { return reduce(Index(i), Index(j - i)); },
+                combine,
+                [scan](size_t i, size_t j, const T& prefix) mutable { scan(Index(i), Index(j - i), prefix); });
+            apex(tiles.total());
+            return;
+        }
+        // A single tile, or out of memory for the tiles; the two passes need one sum per tile only
+        const Index tilesize = Index(fork_join_blocksize(n));
+        const Index m = (n-1)/tilesize + 1;
+        raw_buffer buf(m>1 ? m*sizeof(T) : 0);
+        if( m>1 && buf ) {
+            T* r = static_cast<T*>(buf.get());
+            fork_join_execute([=](task_context& context) mutable {
+                fork_join_for(Index(0), m, 1, context, [=](Index i, Index j) mutable {
+                    for( ; i != j; ++i )
+                        r[i] = reduce(i*tilesize, std::min(tilesize, n - i*tilesize));
+                });
+                if( context.is_cancelled() )
+                    return;
+                // Replace the reductions of the tiles with their exclusive prefix sums
+                T t = initial;
+                for( Index i = 0; i < m; ++i ) {
+                    const T s = r[i];
+                    r[i] = t;
+                    t = combine(t, s);
+                }
+                apex(t);
+                fork_join_for(Index(0), m, 1, context, [=](Index i, Index j) mutable {
+                    for( ; i != j; ++i )
+                        scan(i*tilesize, std::min(tilesize, n - i*tilesize), r[i]);
+                });
+            });
+            return;
+        }
+    }
+    // Fewer than 2 elements in sequence, or out of memory.  Handle has single block.
+    T sum = initial;
+    if(n)
+        sum = combine(sum, reduce(Index(0), n));
+    apex(sum);
+    if(n)
+        scan(Index(0), n, initial);
+}
+
+//------------------------------------------------------------------------
+// parallel_or
+//------------------------------------------------------------------------
+
+//! Return true if brick f[i,j) returns true for some subrange [i,j) of [first,last)
+template<class Index, class Brick>
+bool parallel_or( Index first, Index last, Brick f ) {
+    std::atomic<bool> found(false);
+    parallel_for(first, last, [f, &found](Index i, Index j) {
+        if (!found.load(std::memory_order_relaxed) && f(i, j)) {
+            found.store(true, std::memory_order_relaxed);
+            cancel_execution();
+        }}
+    );
+    return found;
+}
+
+//------------------------------------------------------------------------
+// parallel_invoke
+//------------------------------------------------------------------------
+
+//! Evaluation of f1() and f2(), possibly in parallel
+template<class F1, class F2>
+void parallel_invoke(F1 f1, F2 f2) {
+    fork_join_execute([&f1, &f2](task_context& context) {
+        invoke_tasks(context, f1, f2);
+    });
+}
+
+//------------------------------------------------------------------------
+// enqueue
+//------------------------------------------------------------------------
+
+//! Start f() on a new thread without waiting for it
+/** The new thread is the root of the algorithms that f() calls, as any thread of the application is. */
+template<typename F>
+void enqueue(const F& f) {
+    std::thread(f).detach();
+}
+
+//------------------------------------------------------------------------
+// parallel_first
+//------------------------------------------------------------------------
+
+/** Return minimum value returned by brick f[i,j) for subranges [i,j) of [first,last)
+    Each f[i,j) must return a value in [i,j). */
+template<class Index, class Brick>
+Index parallel_first( Index first, Index last, Brick f ) {
+    typedef typename std::iterator_traits<Index>::difference_type difference_type;
+    std::atomic<difference_type> minimum( last-first );
+    parallel_for(first, last, [f, first, &minimum](Index i, Index j) {
+        // See "Reducing Contention Through Priority Updates", PPoPP '13, for discussion of
+        // why using a shared variable scales fairly well in this situation.
+        if (i - first < minimum) {
+            Index res = f(i, j);
+            // If not 'last' returned then we found what we want so put this to minimum
+            if (res != j) {
+                const difference_type k = res - first;
+                for (difference_type old = minimum; k < old; old = minimum) {
+                    minimum.compare_exchange_weak(old, k);
+                }
+            }
+        }
+    });
+    return first + minimum;
+}
+
+//------------------------------------------------------------------------
+// parallel_stable_sort
+//------------------------------------------------------------------------
+
+//! Merge [xs,xe) and [ys,ye) into zs, splitting the larger sequence at its middle
+template<typename RandomAccessIterator1, typename RandomAccessIterator2, typename RandomAccessIterator3, typename Compare, typename Cleanup>
+void fork_join_merge(RandomAccessIterator1 xs, RandomAccessIterator1 xe, RandomAccessIterator2 ys, RandomAccessIterator2 ye, RandomAccessIterator3 zs, Compare comp, Cleanup cleanup, task_context& context) {
+    const size_t MERGE_CUT_OFF = 2000;
+    if( size_t((xe-xs) + (ye-ys)) <= MERGE_CUT_OFF ) {
+        serial_move_merge(xs, xe, ys, ye, zs, comp);
+
+        //we clean the buffer one time on last step of the sort
+        cleanup(xs, xe);
+        cleanup(ys, ye);
+    }
+    else {
+        RandomAccessIterator1 xm;
+        RandomAccessIterator2 ym;
+        if(xe-xs < ye-ys) {
+            ym = ys+(ye-ys)/2;
+            xm = std::upper_bound(xs, xe, *ym, comp);
+        }
+        else {
+            xm = xs+(xe-xs)/2;
+            ym = std::lower_bound(ys, ye, *xm, comp);
+        }
+        const RandomAccessIterator3 zm = zs + ((xm-xs) + (ym-ys));
+        invoke_tasks(context,
+            [&]() { fork_join_merge(xs, xm, ys, ym, zs, comp, cleanup, context); },
+            [&]() { fork_join_merge(xm, xe, ym, ye, zm, comp, cleanup, context); });
+    }
+}
+
+//! Sort [xs,xe), with zs as a buffer of the same size
+/** inplace==2: the result is in xs and zs is raw memory.
+    inplace==1: the result is in xs and zs is initialized.
+    inplace==0: the result is moved into zs, which is raw memory. */
+template<typename RandomAccessIterator1, typename RandomAccessIterator2, typename Compare, typename LeafSort>
+void fork_join_stable_sort(RandomAccessIterator1 xs, RandomAccessIterator1 xe, RandomAccessIterator2 zs, int32_t inplace, Compare comp, LeafSort leaf_sort, task_context& context) {
+    if( xe - xs <= STABLE_SORT_CUT_OFF ) {
+        leaf_sort(xs, xe, comp);
+        if( inplace!=2 )
+            merge_sort_init_temp_buf(xs, xe, zs, inplace!=0);
+        return;
+    }
+    const RandomAccessIterator1 xm = xs + (xe - xs) / 2;
+    const RandomAccessIterator2 zm = zs + (xm - xs);
+    const RandomAccessIterator2 ze = zs + (xe - xs);
+    invoke_tasks(context,
+        [&]() { fork_join_stable_sort(xs, xm, zs, !inplace, comp, leaf_sort, context); },
+        [&]() { fork_join_stable_sort(xm, xe, zm, !inplace, comp, leaf_sort, context); });
+    if( context.is_cancelled() )
+        return;
+    if( inplace == 2 )
+        fork_join_merge(zs, zm, zm, ze, xs, comp, serial_destroy(), context);
+    else if( inplace )
+        fork_join_merge(zs, zm, zm, ze, xs, comp, binary_no_op(), context);
+    else
+        fork_join_merge(xs, xm, xm, xe, zs, comp, binary_no_op(), context);
+}
+
+template<typename RandomAccessIterator, typename Compare, typename LeafSort>
+void parallel_stable_sort( RandomAccessIterator xs, RandomAccessIterator xe, Compare comp, LeafSort leaf_sort ) {
+    typedef typename std::iterator_traits<RandomAccessIterator>::value_type T;
+    if( xe-xs > STABLE_SORT_CUT_OFF ) {
+        raw_buffer buf( sizeof(T)*(xe-xs) );
+        if( buf ) {
+            T* const zs = static_cast<T*>(buf.get());
+            fork_join_execute([&](task_context& context) {
+                fork_join_stable_sort(xs, xe, zs, 2, comp, leaf_sort, context);
+            });
+            return;
+        }
+    }
+    // Not enough memory available or sort too small - fall back on serial sort
+    leaf_sort( xs, xe, comp );
+}
+
+} // namespace par_backend
+} // namespace pstl
+
+#endif /* __PSTL_parallel_backend_fork_join_H */
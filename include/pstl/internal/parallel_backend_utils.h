@@ -0,0 +1,413 @@
+/*
+    Copyright (c) 2017 Intel Corporation
+
+    Licensed under the Apache License, Version 2.0 (the "License");
+    you may not use this file except in compliance with the License.
+    You may obtain a copy of the License at
+
+        http://www.apache.org/licenses/LICENSE-2.0
+
+    Unless required by applicable law or agreed to in writing, software
+    distributed under the License is distributed on an "AS IS" BASIS,
+    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+    See the License for the specific language governing permissions and
+    limitations under the License.
+
+
+
+
+*/
+
+#ifndef __PSTL_parallel_backend_utils_H
+#define __PSTL_parallel_backend_utils_H
+
+#include <new>
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <type_traits>
+#include <iterator>
+#include <utility>
+#include <algorithm>
+#include <vector>
+// This header defines the serial utilities shared by the threading backends of Parallel STL
+
+#include "parallel_settings.h"
+
+namespace pstl {
+namespace par_backend {
+
+//! Raw memory buffer with automatic freeing and no exceptions.
+/** Some of our algorithms need to start with raw memory buffer,
+not an initialize array, because initialization/destruction
+would make the span be at least O(N). */
+class raw_buffer {
+    void* ptr;
+    raw_buffer(const raw_buffer&) = delete;
+    void operator=(const raw_buffer&) = delete;
+public:
+    //! Try to obtain buffer of given size.
+    raw_buffer(size_t bytes): ptr(operator new(bytes, std::nothrow)) {}
+    //! True if buffer was successfully obtained, zero otherwise.
+    operator bool() const { return ptr != NULL; }
+    //! Return pointer to buffer, or  NULL if buffer could not be obtained.
+    void* get() const { return ptr; }
+    //! Destroy buffer
+    ~raw_buffer() { operator delete(ptr); }
+};
+
+//------------------------------------------------------------------------
+// stable_sort utilities
+//
+// These are used by parallel implementations but do not depend on them.
+//------------------------------------------------------------------------
+
+//! Destroy sequence [xs,xe)
+struct serial_destroy {
+    template<typename RandomAccessIterator>
+    void operator()(RandomAccessIterator zs, RandomAccessIterator ze) const {
+        typedef typename std::iterator_traits<RandomAccessIterator>::value_type T;
+        while(zs!=ze) {
+            --ze;
+            (*ze).~T();
+        }
+    }
+};
+
+//! Merge sequences [xs,xe) and [ys,ye) to output sequence [zs,(xe-xs)+(ye-ys)), using std::move
+template<class RandomAccessIterator1, class RandomAccessIterator2, class RandomAccessIterator3, class Compare>
+void serial_move_merge(RandomAccessIterator1 xs, RandomAccessIterator1 xe, RandomAccessIterator2 ys, RandomAccessIterator2 ye, RandomAccessIterator3 zs, Compare comp) {
+    if(xs!=xe) {
+        if(ys!=ye) {
+            for(;;)
+                if(comp(*ys, *xs)) {
+                    *zs = std::move(*ys);
+                    ++zs;
+                    if(++ys==ye) break;
+                }
+                else {
+                    *zs = std::move(*xs);
+                    ++zs;
+                    if(++xs==xe) goto movey;
+                }
+        }
+        ys = xs;
+        ye = xe;
+    }
+movey:
+    std::move(ys, ye, zs);
+}
+
+template<typename RandomAccessIterator1, typename RandomAccessIterator2>
+void merge_sort_init_temp_buf(RandomAccessIterator1 xs, RandomAccessIterator1 xe, RandomAccessIterator2 zs, bool inplace) {
+    const RandomAccessIterator2 ze = zs + (xe-xs);
+    typedef typename std::iterator_traits<RandomAccessIterator2>::value_type T;
+    if(inplace)
+        // Initialize the temporary buffer
+        for(; zs!=ze; ++zs)
+            new(&*zs) T;
+    else
+        // Initialize the temporary buffer and move keys to it.
+        for(; zs!=ze; ++xs, ++zs)
+            new(&*zs) T(std::move(*xs));
+}
+
+//! Binary operator that does nothing
+struct binary_no_op {
+    template<typename T>
+    void operator()(T, T) const {}
+};
+
+const size_t STABLE_SORT_CUT_OFF = 500;
+
+//------------------------------------------------------------------------
+// serial cutoff
+//------------------------------------------------------------------------
+
+//! Minimal number of elements in the sample timed by policy.with_auto_cutoff()
+const size_t AUTO_CUTOFF_MIN_SAMPLE = 16;
+//! Number of samples per thread a range would hold; the sample is a small part of a large range
+const size_t AUTO_CUTOFF_SAMPLES_PER_THREAD = 64;
+//! Time below which a range runs serially, about the cost of starting a parallel algorithm
+const double AUTO_CUTOFF_NANOSECONDS = 20000;
+
+//! Run f(i,j) for the head [first,i) of [first,last) that the policy of the algorithm asks to run serially
+/** Advances first past the head and returns true if the whole range ran serially.
+    Below the serial cutoff of the policy the head is the whole range.
+    With policy.with_auto_cutoff(), the head is a sample whose time tells whether the rest
+    is worth running in parallel on the given number of threads. */
+template<class Index, class F>
+bool run_serial_head(Index& first, Index last, size_t concurrency, F f) {
+    const size_t n = last - first;
+    if( n < internal::policy_serial_cutoff() ) {
+        if( n )
+            f(first, last);
+        first = last;
+        return true;
+    }
+    if( !internal::auto_serial_cutoff() )
+        return false;
+    const size_t sample = std::min(n, std::max(AUTO_CUTOFF_MIN_SAMPLE, n/(AUTO_CUTOFF_SAMPLES_PER_THREAD*concurrency)));
+    const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    f(first, first + sample);
+    const double elapsed = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+    first += sample;
+    if( first == last )
+        return true;
+    if( elapsed*(n - sample) >= AUTO_CUTOFF_NANOSECONDS*sample )
+        return false;
+    f(first, last);
+    first = last;
+    return true;
+}
+
+//------------------------------------------------------------------------
+// chained scan
+//
+// Single-pass scan with decoupled look-back (D. Merrill, M. Garland,
+// "Single-pass Parallel Prefix Scan with Decoupled Look-back", 2016).
+// Each tile is reduced and then scanned by the same thread while it is
+// still in cache; the exclusive prefix of a tile is found by looking back
+// at the tiles before it as far as the first one with a published prefix.
+//------------------------------------------------------------------------
+
+//! Maximal number of elements of a tile of the chained scan
+const size_t CHAINED_SCAN_MAX_TILE = 1<<13;
+//! Minimal number of tiles per thread of the chained scan, for load balancing
+const size_t CHAINED_SCAN_TILES_PER_THREAD = 4;
+
+//! Whether a scan with generalized sums of type T can publish them through the tiles of the chained scan
+template<typename T>
+struct is_chained_scan_value: std::integral_constant<bool, std::is_trivially_copyable<T>::value> {};
+
+//! Number of elements of a tile of the chained scan of n elements on p threads
+/** The tiles are as big as the chunks requested by the policy of the algorithm, if any,
+    and there is one tile per thread with static partitioning. A reproducible scan has
+    tiles of the size of its blocks, whatever the number of threads. */
+inline size_t chained_scan_tilesize(size_t n, size_t p) {
+    if( internal::reproducible() )
+        return internal::reproducible_blocksize();
+    const size_t grainsize = internal::policy_grainsize();
+    if( internal::static_partitioning() )
+        return std::max(grainsize, (n - 1)/p + 1);
+    if( grainsize )
+        return grainsize;
+    return std::min(CHAINED_SCAN_MAX_TILE, (n - 1)/(CHAINED_SCAN_TILES_PER_THREAD*p) + 1);
+}
+
+//! Tiles of a chained scan of [0,n), claimed in order by the threads that run it
+/** A tile publishes the reduction of its elements, then its inclusive prefix.
+    Since the tiles are claimed in order and a claimed tile is processed without
+    waiting for later ones, a thread that looks back only waits for threads that run.
+    An ordered scan looks back at the prefix of the previous tile only, so that each prefix
+    is the combination of the previous prefix and reduction, however the threads interleave. */
+template<typename T>
+class chained_scan {
+    enum status_type { status_empty, status_aggregate, status_prefix };
+    struct tile {
+        std::atomic<int> status;
+        T aggregate;
+        T prefix;
+    };
+    const size_t my_n;
+    const size_t my_tilesize;
+    const size_t my_m;
+    const bool my_ordered;
+    raw_buffer my_buffer;
+    tile* const my_tiles;
+    std::atomic<size_t> my_next;
+    std::atomic<bool> my_failed;
+    chained_scan(const chained_scan&) = delete;
+    void operator=(const chained_scan&) = delete;
+
+    //! Wait until tile k publishes at least the given status and return its status, or status_empty if a tile failed
+    int wait(size_t k, int least = status_aggregate) const {
+        int status;
+        for( size_t spin = 0; (status = my_tiles[k].status.load(std::memory_order_acquire)) < least; ++spin ) {
+            if( my_failed.load(std::memory_order_relaxed) )
+                return status_empty;
+            if( spin >= 64 )
+                std::this_thread::yield();
+        }
+        return status;
+    }
+    //! Compute the combination of initial with tiles [0,k) into prefix; return false if a tile failed
+    template<typename C>
+    bool look_back(size_t k, C& combine, T& prefix) const {
+        size_t j = k - 1;
+        int status = wait(j, my_ordered ? status_prefix : status_aggregate);
+        if( status == status_empty )
+            return false;
+        prefix = status == status_prefix ? my_tiles[j].prefix : my_tiles[j].aggregate;
+        while( status != status_prefix ) {
+            status = wait(--j);
+            if( status == status_empty )
+                return false;
+            prefix = combine(status == status_prefix ? my_tiles[j].prefix : my_tiles[j].aggregate, prefix);
+        }
+        return true;
+    }
+public:
+    //! Try to obtain the tiles of tilesize elements of [0,n), with n>0
+    chained_scan(size_t n, size_t tilesize, bool ordered = false):
+        my_n(n), my_tilesize(tilesize), my_m((n - 1)/tilesize + 1), my_ordered(ordered),
+        my_buffer(my_m*sizeof(tile)), my_tiles(static_cast<tile*>(my_buffer.get())),
+        my_next(0), my_failed(false)
+    {
+        if( my_tiles )
+            for( size_t k = 0; k < my_m; ++k )
+                new(&my_tiles[k].status) std::atomic<int>(status_empty);
+    }
+    //! True if the tiles were successfully obtained
+    explicit operator bool() const { return my_tiles != NULL; }
+    //! Number of tiles
+    size_t size() const { return my_m; }
+    //! Combination of initial with all tiles, after all tiles are processed
+    const T& total() const { return my_tiles[my_m - 1].prefix; }
+
+    //! Process the tiles claimed by the calling thread until none is left
+    /** reduce(i,j) returns the reduction of the tile [i,j), and scan(i,j,prefix) scans it
+        starting with prefix, the combination of initial with the tiles before it. */
+    template<typename R, typename C, typename S>
+    void run(const T& initial, R reduce, C combine, S scan) {
+        for( size_t k = my_next++; k < my_m; k = my_next++ ) {
+            const size_t i = k*my_tilesize;
+            const size_t j = std::min(i + my_tilesize, my_n);
+            try {
+                const T aggregate = reduce(i, j);
+                T prefix = initial;
+                if( k ) {
+                    my_tiles[k].aggregate = aggregate;
+                    my_tiles[k].status.store(status_aggregate, std::memory_order_release);
+                    if( !look_back(k, combine, prefix) )
+                        return;
+                }
+                my_tiles[k].prefix = combine(prefix, aggregate);
+                my_tiles[k].status.store(status_prefix, std::memory_order_release);
+                scan(i, j, prefix);
+            } catch(...) {
+                // The threads waiting for the tile give up, and the exception goes on to the backend
+                my_failed = true;
+                throw;
+            }
+        }
+    }
+};
+
+//! Scan the tiles of tilesize elements of [0,n) one after another, with the sums of an ordered chained scan
+/** For the reproducible scans whose tiles cannot be published; returns the combination of prefix with all tiles. */
+template<typename T, typename R, typename C, typename S>
+T serial_tiled_scan(size_t n, size_t tilesize, T prefix, R reduce, C combine, S scan) {
+    for( size_t i = 0; i < n; i += tilesize ) {
+        const size_t j = std::min(i + tilesize, n);
+        const T aggregate = reduce(i, j);
+        scan(i, j, prefix);
+        prefix = combine(prefix, aggregate);
+    }
+    return prefix;
+}
+
+//------------------------------------------------------------------------
+// multiway merge utilities
+//------------------------------------------------------------------------
+
+//! Minimal number of ways for which the multiway merge is used.
+const size_t MULTIWAY_MERGE_MIN_WAYS = 4;
+//! Minimal number of elements per way for which the multiway merge is used.
+const size_t MULTIWAY_MERGE_MIN_CHUNK = 1<<13;
+
+//! Whether x from range a precedes y from range b in a stable merge
+template<typename T, typename Compare>
+bool multiway_precedes(const T& x, size_t a, const T& y, size_t b, Compare comp) {
+    return comp(x, y) || (!comp(y, x) && a < b);
+}
+
+//! Find positions s[i] in sorted ranges [xs[i], xe[i]) such that the elements before them are the rank first elements of the merge
+/** The positions are narrowed by ranking the middle element of the widest remaining interval. */
+template<typename T, typename Compare>
+void multiway_select(T* const* xs, T* const* xe, size_t k, size_t rank, size_t* s, Compare comp) {
+    std::vector<size_t> hi(k), c(k);
+    for( size_t i = 0; i < k; ++i ) {
+        s[i] = 0;
+        hi[i] = xe[i] - xs[i];
+    }
+    for(;;) {
+        size_t j = k, width = 0;
+        for( size_t i = 0; i < k; ++i )
+            if( hi[i] - s[i] > width ) {
+                width = hi[i] - s[i];
+                j = i;
+            }
+        if( j == k )
+            break;
+        const size_t p = s[j] + width/2;
+        const T& pivot = xs[j][p];
+        // Count elements that precede the pivot in each range
+        size_t r = 0;
+        for( size_t i = 0; i < k; ++i ) {
+            if( i < j )
+                c[i] = std::upper_bound(xs[i], xe[i], pivot, comp) - xs[i];
+            else if( i > j )
+                c[i] = std::lower_bound(xs[i], xe[i], pivot, comp) - xs[i];
+            else
+                c[i] = p;
+            r += c[i];
+        }
+        if( r < rank ) {
+            // The pivot and its predecessors are among the first rank elements
+            for( size_t i = 0; i < k; ++i )
+                s[i] = std::max(s[i], c[i]);
+            s[j] = p + 1;
+        }
+        else {
+            // The pivot and its successors are not
+            for( size_t i = 0; i < k; ++i )
+                hi[i] = std::min(hi[i], c[i]);
+        }
+    }
+}
+
+//! Stable k-way merge of sorted ranges [xs[i], xe[i]) into zs with a tree of losers (D. Knuth, TAOCP vol. 3, 5.4.1)
+template<typename T, typename RandomAccessIterator, typename Compare>
+void serial_multiway_move_merge(T** xs, T* const* xe, size_t k, RandomAccessIterator zs, Compare comp) {
+    // Leaves beyond k stand for exhausted ranges
+    size_t m = 1;
+    while( m < k )
+        m *= 2;
+    auto beats = [xs, xe, k, &comp](size_t a, size_t b) -> bool {
+        if( a >= k || xs[a] == xe[a] )
+            return false;
+        if( b >= k || xs[b] == xe[b] )
+            return true;
+        return multiway_precedes(*xs[a], a, *xs[b], b, comp);
+    };
+    // loser[0] is the overall winner; loser[i] is the loser of the match at node i
+    std::vector<size_t> loser(m), winner(2*m);
+    size_t count = 0;
+    for( size_t i = 0; i < m; ++i ) {
+        winner[m + i] = i;
+        if( i < k )
+            count += xe[i] - xs[i];
+    }
+    for( size_t i = m - 1; i > 0; --i ) {
+        const size_t a = winner[2*i], b = winner[2*i + 1];
+        const bool a_wins = beats(a, b);
+        winner[i] = a_wins ? a : b;
+        loser[i] = a_wins ? b : a;
+    }
+    loser[0] = winner[1];
+    for( ; count; --count, ++zs ) {
+        size_t w = loser[0];
+        *zs = std::move(*xs[w]);
+        ++xs[w];
+        for( size_t i = (w + m)/2; i > 0; i /= 2 )
+            if( beats(loser[i], w) )
+                std::swap(loser[i], w);
+        loser[0] = w;
+    }
+}
+
+} // namespace par_backend
+} // namespace pstl
+
+#endif /* __PSTL_parallel_backend_utils_H */
@@ -0,0 +1,80 @@
+/*
+    Copyright (c) 2017 Intel Corporation
+
+    Licensed under the Apache License, Version 2.0 (the "License");
+    you may not use this file except in compliance with the License.
+    You may obtain a copy of the License at
+
+        http://www.apache.org/licenses/LICENSE-2.0
+
+    Unless required by applicable law or agreed to in writing, software
+    distributed under the License is distributed on an "AS IS" BASIS,
+    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+    See the License for the specific language governing permissions and
+    limitations under the License.
+
+
+
+
+*/
+
+#ifndef __PSTL_parallel_impl_omp_H
+#define __PSTL_parallel_impl_omp_H
+
+#include <cstddef>
+// This header defines the minimum set of parallel routines required to support Parallel STL,
+// implemented on top of OpenMP tasks
+
+#include <omp.h>
+
+#if !defined(_OPENMP) || _OPENMP < 200805
+#error OpenMP 3.0 is required; the compiler must be invoked with OpenMP enabled.
+#endif
+
+#include "parallel_settings.h"
+
+namespace pstl {
+namespace par_backend {
+
+//! Number of threads that can execute the parallel algorithms
+/** Inside a parallel region the algorithms run on the tasks of the enclosing team. */
+inline size_t max_concurrency() {
+    return omp_in_parallel() ? omp_get_num_threads() : omp_get_max_threads();
+}
+
+//! Execute f() on the team of the enclosing parallel region, or on a new team if there is none
+/** The new team has at most as many threads as the policy of the algorithm allows. */
+template<typename F>
+void execute_root(const F& f) {
+    if( omp_in_parallel() )
+        f();
+    else {
+        int n = omp_get_max_threads();
+        if( const internal::parallel_settings* settings = internal::current_parallel_settings() )
+            if( settings->concurrency && settings->concurrency < size_t(n) )
+                n = int(settings->concurrency);
+        #pragma omp parallel num_threads(n)
+        {
+            #pragma omp single nowait
+            f();
+        }
+    }
+}
+
+//! Execute f1() and f2() in context, the former as a separate task, and wait for both
+template<typename Context, typename F1, typename F2>
+void invoke_tasks(Context& context, const F1& f1, const F2& f2) {
+    Context* const c = &context;
+    const F1* const f = &f1;
+    #pragma omp task firstprivate(c, f)
+    c->run(*f);
+    context.run(f2);
+    #pragma omp taskwait
+}
+
+} // namespace par_backend
+} // namespace pstl
+
+#include "parallel_backend_fork_join.h"
+
+#endif /* __PSTL_parallel_impl_omp_H */
@@ -22,6 +22,12 @@
 #define __PSTL_parallel_impl_tbb_H
 
 #include <atomic>
+#include <algorithm>
+#include <cstdint>
+#include <exception>
+#include <map>
+#include <memory>
+#include <vector>
 // This header defines the minimum set of parallel routines required to support Parallel STL,
 // implemented on top of Intel(R) Threading Building Blocks (Intel(R) TBB) library
 
@@ -31,7 +37,14 @@
 #include <tbb/parallel_reduce.h>
 #include <tbb/parallel_scan.h>
 #include <tbb/parallel_invoke.h>
+#include <tbb/task_group.h>
 #include <tbb/task_arena.h>
+#if TBB_INTERFACE_VERSION >= 12000
+#include <tbb/info.h>
+#endif
+
+#include "parallel_backend_utils.h"
+#include "parallel_settings.h"
 
 #if TBB_INTERFACE_VERSION < 10000
 #error Intel(R) Threading Building Blocks 2018 is required; older versions are not supported.
@@ -40,30 +53,168 @@
 namespace pstl {
 namespace par_backend {
 
-//! Raw memory buffer with automatic freeing and no exceptions.
-/** Some of our algorithms need to start with raw memory buffer,
-not an initialize array, because initialization/destruction
-would make the span be at least O(N). */
-class raw_buffer {
-    void* ptr;
-    raw_buffer(const raw_buffer&) = delete;
-    void operator=(const raw_buffer&) = delete;
+//! Number of threads that can execute the parallel algorithms
+inline size_t max_concurrency() {
+    return tbb::this_task_arena::max_concurrency();
+}
+
+//! Arena with at most n threads for the algorithms that the calling thread executes with policy.with_concurrency(n)
+/** Each thread has its own arenas, so that concurrent algorithms do not share the limit. */
+inline tbb::task_arena& concurrency_arena(size_t n) {
+    static thread_local std::map<size_t, std::unique_ptr<tbb::task_arena> > arenas;
+    std::unique_ptr<tbb::task_arena>& arena = arenas[n];
+    if( !arena )
+        arena.reset(new tbb::task_arena(int(n)));
+    return *arena;
+}
+
+//! Execute f() isolated from other work of the calling thread, in the arena requested by the policy if any
+/** policy.on(arena) takes precedence over policy.with_concurrency(n).
+    The arena may run f() on another thread, which then applies the settings of the policy too. */
+template<typename F>
+auto execute_root(const F& f) -> decltype(f()) {
+    tbb::task_arena* arena = NULL;
+    const internal::parallel_settings* settings = internal::current_parallel_settings();
+    if( settings ) {
+        arena = settings->arena;
+        if( !arena && settings->concurrency )
+            arena = &concurrency_arena(settings->concurrency);
+    }
+    if( arena )
+        return arena->execute([&f, settings]() {
+            const internal::parallel_settings_scope scope(*settings);
+            return tbb::this_task_arena::isolate(f);
+        });
+    return tbb::this_task_arena::isolate(f);
+}
+
+//! Arenas whose threads are constrained to the NUMA nodes of the machine, one per node
+/** A machine without NUMA support, or a TBB without tbb::info, has a single node. */
+inline const std::vector<std::unique_ptr<tbb::task_arena> >& numa_arenas() {
+    static const std::vector<std::unique_ptr<tbb::task_arena> > arenas = []() {
+        std::vector<std::unique_ptr<tbb::task_arena> > result;
+#if TBB_INTERFACE_VERSION >= 12000
+        for( tbb::numa_node_id node: tbb::info::numa_nodes() )
+            result.emplace_back(new tbb::task_arena(tbb::task_arena::constraints(node)));
+#else
+        result.emplace_back(new tbb::task_arena());
+#endif
+        return result;
+    }();
+    return arenas;
+}
+
+//! Execute f(node, i, j) for the slice [i,j) of [first,last) of each NUMA node, in the arena of the node
+/** The slices are proportional to the threads of the nodes and depend only on last-first, so the
+    algorithms with policy.with_numa() over the same range touch each element from the same node.
+    Each slice runs with the settings of the policy but the placement, concurrency, arena and serial cutoff. */
+template<class Index, class F>
+void numa_for(Index first, Index last, F f) {
+    const std::vector<std::unique_ptr<tbb::task_arena> >& arenas = numa_arenas();
+    const size_t m = arenas.size();
+    internal::parallel_settings settings(*internal::current_parallel_settings());
+    settings.numa_placement = false;
+    settings.concurrency = 0;
+    settings.arena = NULL;
+    settings.affinity_state = NULL;
+    settings.serial_cutoff = 0;
+    settings.auto_cutoff = false;
+
+    std::vector<size_t> threads(m + 1, 0);
+    for( size_t k = 0; k < m; ++k )
+        threads[k + 1] = threads[k] + size_t(arenas[k]->max_concurrency());
+    const size_t n = last - first;
+    const auto slice_begin = [&](size_t k) -> Index {
+        return first + n/threads[m]*threads[k] + n%threads[m]*threads[k]/threads[m];
+    };
+
+    std::unique_ptr<tbb::task_group[]> groups(new tbb::task_group[m]);
+    for( size_t k = 0; k < m; ++k ) {
+        const Index i = slice_begin(k), j = slice_begin(k + 1);
+        if( i != j )
+            arenas[k]->execute([&, k, i, j]() {
+                groups[k].run([&settings, &f, k, i, j]() {
+                    const internal::parallel_settings_scope scope(settings);
+                    f(k, i, j);
+                });
+            });
+    }
+    // Wait for all slices before rethrowing the first exception
+    std::exception_ptr exception;
+    for( size_t k = 0; k < m; ++k )
+        arenas[k]->execute([&]() {
+            try {
+                groups[k].wait();
+            }
+            catch(...) {
+                if( !exception )
+                    exception = std::current_exception();
+            }
+        });
+    if( exception )
+        std::rethrow_exception(exception);
+}
+
+//! Context of the innermost parallel_for or parallel_reduce body executed by the calling thread
+inline tbb::task_group_context*& current_context() {
+    static thread_local tbb::task_group_context* context = NULL;
+    return context;
+}
+
+//! Make context current for the calling thread while in scope
+class context_scope {
+    tbb::task_group_context*& my_current;
+    tbb::task_group_context* const my_saved;
+    context_scope(const context_scope&) = delete;
+    void operator=(const context_scope&) = delete;
+public:
+    explicit context_scope(tbb::task_group_context& context): my_current(current_context()), my_saved(my_current) {
+        my_current = &context;
+    }
+    ~context_scope() { my_current = my_saved; }
+};
+
+//! Make no context current for the calling thread while in scope
+/** A body that runs serially, outside of any parallel_for or parallel_reduce,
+    then cannot cancel the algorithm that encloses its own. */
+class serial_scope {
+    tbb::task_group_context* const my_saved;
+    serial_scope(const serial_scope&) = delete;
+    void operator=(const serial_scope&) = delete;
 public:
-    //! Try to obtain buffer of given size.
-    raw_buffer(size_t bytes): ptr(operator new(bytes, std::nothrow)) {}
-    //! True if buffer was successfully obtained, zero otherwise.
-    operator bool() const { return ptr != NULL; }
-    //! Return pointer to buffer, or  NULL if buffer could not be obtained.
-    void* get() const { return ptr; }
-    //! Destroy buffer
-    ~raw_buffer() { operator delete(ptr); }
+    serial_scope(): my_saved(current_context()) {
+        current_context() = NULL;
+    }
+    ~serial_scope() { current_context() = my_saved; }
 };
 
-// Wrapper for tbb::task
+//! Cancel the parallel_for or parallel_reduce whose body calls it
 inline void cancel_execution() {
-    tbb::task::self().group()->cancel_group_execution();
+    if( tbb::task_group_context* context = current_context() )
+        context->cancel_group_execution();
 }
 
+//! Affinity partitioner of the policy of the algorithm, owned by the algorithm while in scope
+/** Null if the policy has no affinity or another algorithm replays it;
+    such an algorithm falls back to static_partitioner. */
+class affinity_scope {
+    execution::affinity* my_affinity;
+    affinity_scope(const affinity_scope&) = delete;
+    void operator=(const affinity_scope&) = delete;
+public:
+    affinity_scope(): my_affinity(internal::policy_affinity()) {
+        if( my_affinity && !my_affinity->__try_acquire() )
+            my_affinity = NULL;
+    }
+    ~affinity_scope() {
+        if( my_affinity )
+            my_affinity->__release();
+    }
+    tbb::affinity_partitioner* partitioner() const {
+        return my_affinity ? &my_affinity->__partitioner() : NULL;
+    }
+};
+
 //------------------------------------------------------------------------
 // parallel_for
 //------------------------------------------------------------------------
@@ -71,35 +222,88 @@ inline void cancel_execution() {
 template <class Index, class RealBody>
 class parallel_for_body {
 public:
-    parallel_for_body( const RealBody& body) : my_body( body ) { }
-    parallel_for_body(const parallel_for_body& body): my_body(body.my_body) { }
+    parallel_for_body( const RealBody& body, tbb::task_group_context& context) : my_body( body ), my_context( context ) { }
+    parallel_for_body(const parallel_for_body& body): my_body(body.my_body), my_context(body.my_context) { }
     void operator()(const tbb::blocked_range<Index>& range) const {
+        context_scope scope(my_context);
         my_body(range.begin(), range.end());
     }
 private:
     RealBody my_body;
+    tbb::task_group_context& my_context;
 };
 
 //! Evaluation of brick f[i,j) for each subrange [i,j) of [first,last)
 // wrapper over tbb::parallel_for
+// The policy of the algorithm may ask for chunks of at least a given size (simple_partitioner) and one chunk per thread (static_partitioner),
+// or to replay the mapping of chunks to threads of the previous algorithms (affinity_partitioner).
 template<class Index, class F>
 void parallel_for(Index first, Index last, F f) {
-    tbb::this_task_arena::isolate([=]() {
-        tbb::parallel_for(tbb::blocked_range<Index>(first, last), parallel_for_body<Index, F>(f));
+    if( run_serial_head(first, last, max_concurrency(), [&f](Index i, Index j) { serial_scope scope; f(i, j); }) )
+        return;
+    if( internal::numa_placement() ) {
+        numa_for(first, last, [&f](size_t, Index i, Index j) { parallel_for(i, j, f); });
+        return;
+    }
+    const size_t grainsize = internal::policy_grainsize();
+    const bool is_static = internal::static_partitioning();
+    const affinity_scope affinity;
+    execute_root([=, &affinity]() {
+        tbb::task_group_context context;
+        const tbb::blocked_range<Index> range(first, last, grainsize ? grainsize : 1);
+        const parallel_for_body<Index, F> body(f, context);
+        if( tbb::affinity_partitioner* partitioner = affinity.partitioner() )
+            tbb::parallel_for(range, body, *partitioner, context);
+        else if( is_static )
+            tbb::parallel_for(range, body, tbb::static_partitioner(), context);
+        else if( grainsize )
+            tbb::parallel_for(range, body, tbb::simple_partitioner(), context);
+        else
+            tbb::parallel_for(range, body, tbb::auto_partitioner(), context);
     });
 }
 
 //! Evaluation of brick f[i,j) for each subrange [i,j) of [first,last)
 // wrapper over tbb::parallel_reduce
+// The subranges have at least grainsize elements, whatever the policy of the algorithm asks for.
 template<class Value, class Index, typename RealBody, typename Reduction>
 Value parallel_reduce(Index first, Index last, const Value& identity, const RealBody& real_body, const Reduction& reduction, std::size_t grainsize = 1) {
-    return tbb::this_task_arena::isolate([first, last, grainsize, &identity, &real_body, &reduction]()->Value {
-        return tbb::parallel_reduce(tbb::blocked_range<Index>(first, last, grainsize), identity,
-            [real_body](const tbb::blocked_range<Index>& r, const Value& value)-> Value {
-            return real_body(r.begin(), r.end(), value);
-        },
-        reduction);
-    });
+    const Index begin = first;
+    Value head(identity);
+    if( run_serial_head(first, last, max_concurrency(), [&](Index i, Index j) { serial_scope scope; head = real_body(i, j, head); }) )
+        return head;
+    Value result(identity);
+    if( internal::numa_placement() ) {
+        std::vector<Value> values(numa_arenas().size(), identity);
+        numa_for(first, last, [&](size_t node, Index i, Index j) {
+            values[node] = parallel_reduce(i, j, identity, real_body, reduction, grainsize);
+        });
+        for( const Value& value: values )
+            result = reduction(result, value);
+    }
+    else {
+        const size_t policy_grainsize = internal::policy_grainsize();
+        const bool is_static = internal::static_partitioning();
+        const affinity_scope affinity;
+        result = execute_root([first, last, grainsize, policy_grainsize, is_static, &affinity, &identity, &real_body, &reduction]()->Value {
+            tbb::task_group_context context;
+            const tbb::blocked_range<Index> range(first, last, std::max(grainsize, policy_grainsize));
+            const auto body = [real_body, &context](const tbb::blocked_range<Index>& r, const Value& value)-> Value {
+                context_scope scope(context);
+                return real_body(r.begin(), r.end(), value);
+            };
+            if( tbb::affinity_partitioner* partitioner = affinity.partitioner() )
+                return tbb::parallel_reduce(range, identity, body, reduction, *partitioner, context);
+            else if( is_static )
+                return tbb::parallel_reduce(range, identity, body, reduction, tbb::static_partitioner(), context);
+            else if( policy_grainsize )
+                return tbb::parallel_reduce(range, identity, body, reduction, tbb::simple_partitioner(), context);
+            else
+                return tbb::parallel_reduce(range, identity, body, reduction, tbb::auto_partitioner(), context);
+        });
+    }
+    // The serial head, if any, precedes the rest of the range
+    return first != begin ? reduction(head, result) : result;
 }
 
 //------------------------------------------------------------------------
@@ -152,7 +356,7 @@ struct par_trans_red_body {
         __TBB_ASSERT(range.size() > 1,"there should be at least 2 elements");
             new(&sum_storage) T(combine(u(i), u(i+1))); // The condition i+1 < j is provided by the grain size of 3
             has_sum = true;
-            std::advance(i,2);
+            i += 2;
             if(i==j)
                 return;
         }
@@ -162,10 +366,42 @@ struct par_trans_red_body {
 
 template<class Index, class U, class T, class C, class R>
 T parallel_transform_reduce( Index first, Index last, U u, T init, C combine, R brick_reduce) {
+    if( run_serial_head(first, last, max_concurrency(), [&](Index i, Index j) { serial_scope scope; init = brick_reduce(i, j, init); }) )
+        return init;
     par_trans_red_body<Index, U, T, C, R> body(u, init, combine, brick_reduce);
+    if( internal::reproducible() ) {
+        // The range is split into the same blocks, and their sums joined in the same tree, whatever the number of threads
+        const size_t blocksize = internal::reproducible_blocksize();
+        execute_root([first, last, blocksize, &body]() {
+            tbb::parallel_deterministic_reduce(tbb::blocked_range<Index>(first, last, std::max(blocksize, size_t(3))), body);
+        });
+        return body.sum();
+    }
+    if( internal::numa_placement() ) {
+        // A slice has no identity to start from, so it starts from its first element
+        std::vector<std::unique_ptr<T> > sums(numa_arenas().size());
+        numa_for(first, last, [&](size_t node, Index i, Index j) {
+            sums[node].reset(new T(parallel_transform_reduce(i + 1, j, u, u(i), combine, brick_reduce)));
+        });
+        for( const std::unique_ptr<T>& sum: sums )
+            if( sum )
+                init = combine(init, *sum);
+        return init;
+    }
+    const size_t grainsize = internal::policy_grainsize();
+    const bool is_static = internal::static_partitioning();
+    const affinity_scope affinity;
     // The grain size of 3 is used in order to provide mininum 2 elements for each body
-    tbb::this_task_arena::isolate([first, last, &body]() {
-        tbb::parallel_reduce(tbb::blocked_range<Index>(first, last, 3), body);
+    execute_root([first, last, grainsize, is_static, &affinity, &body]() {
+        const tbb::blocked_range<Index> range(first, last, std::max(grainsize, size_t(3)));
+        if( tbb::affinity_partitioner* partitioner = affinity.partitioner() )
+            tbb::parallel_reduce(range, body, *partitioner);
+        else if( is_static )
+            tbb::parallel_reduce(range, body, tbb::static_partitioner());
+        else if( grainsize )
+            tbb::parallel_reduce(range, body, tbb::simple_partitioner());
+        else
+            tbb::parallel_reduce(range, body);
     });
     return body.sum();
 }
@@ -247,11 +483,48 @@ public:
 
 template<class Index, class U, class T, class C, class R, class S>
 T parallel_transform_scan(Index n, U u, T init, C combine, R brick_reduce, S scan) {
+    if( n && size_t(n) < internal::policy_serial_cutoff() )
+        return scan(Index(0), n, init);
     if(n) {
+        // A single pass over the tiles if their sums can be published, two passes of parallel_scan otherwise
+        const bool is_reproducible = internal::reproducible();
+        if( is_chained_scan_value<T>::value ) {
+            T total = init;
+            const bool is_done = execute_root([n, is_reproducible, &u, &init, &combine, &brick_reduce, &scan, &total]() -> bool {
+                const size_t p = max_concurrency();
+                chained_scan<T> tiles(n, chained_scan_tilesize(n, p), is_reproducible);
+                if( !tiles )
+                    return false;
+                tbb::parallel_for(size_t(0), std::min(p, tiles.size()), [&](size_t) {
+                    tiles.run(init,
+                        [u, brick_reduce](size_t i, size_t j) mutable { return brick_reduce(Index(i + 1), Index(j), u(Index(i))); },
+                        combine,
+                        [scan](size_t i, size_t j, const T& prefix) mutable { scan(Index(i), Index(j), prefix); });
+                });
+                total = tiles.total();
+                return true;
+            });
+            if( is_done )
+                return total;
+        }
+        // The sums of parallel_scan depend on the stealing, so a reproducible scan runs its tiles serially instead
+        if( is_reproducible )
+            return serial_tiled_scan(size_t(n), internal::reproducible_blocksize(), init,
+                [&u, &brick_reduce](size_t i, size_t j) { return brick_reduce(Index(i + 1), Index(j), u(Index(i))); },
+                combine,
+                [&scan](size_t i, size_t j, const T& prefix) { scan(Index(i), Index(j), prefix); });
         trans_scan_body<Index, U, T, C, R, S> body(u, init, combine, brick_reduce, scan);
-        auto range = tbb::blocked_range<Index>(0, n);
-        tbb::this_task_arena::isolate([range, &body]() {
-            tbb::parallel_scan(range, body);
+        // parallel_scan has no static_partitioner; one chunk per thread is asked with the grain size instead
+        const size_t policy_grainsize = internal::policy_grainsize();
+        const bool is_static = internal::static_partitioning();
+        execute_root([n, policy_grainsize, is_static, &body]() {
+            size_t grainsize = policy_grainsize;
+            if( is_static )
+                grainsize = std::max(grainsize, size_t((n - 1)/max_concurrency() + 1));
+            if( grainsize )
+                tbb::parallel_scan(tbb::blocked_range<Index>(0, n, grainsize), body, tbb::simple_partitioner());
+            else
+                tbb::parallel_scan(tbb::blocked_range<Index>(0, n), body);
         });
         return body.sum();
     }
@@ -311,42 +584,86 @@ void downsweep(Index i, Index m, Index tilesize, T* r, Index lastsize, T initial
 // reduce and scan are each called exactly once per subrange.
 // Thus callers can rely upon side effects in reduce.
 // combine must not throw an exception.
-// apex is called exactly once, after all calls to reduce and before all calls to scan.
-// For example, it's useful for allocating a buffer used by scan but whose size is the sum of all reduction values.
+// apex is called exactly once, after all calls to reduce, with the combination of initial and all reduction values.
+// The tiles are scanned in a single pass, each right after its reduction, so apex may be called after the calls to scan,
+// which must not depend on it.
 // T must have a trivial constructor and destructor.
+// The tiles are at least as big as the chunks requested by the policy of the algorithm, if any.
 template<typename Index, typename T, typename R, typename C, typename S, typename A>
 void parallel_strict_scan( Index n, T initial, R reduce, C combine, S scan, A apex ) {
-    tbb::this_task_arena::isolate([=](){
-        if( n>1 ) {
+    const Index grainsize = Index(internal::policy_grainsize());
+    const bool is_static = internal::static_partitioning();
+    const bool is_reproducible = internal::reproducible();
+    // Below the serial cutoff of the policy the sequence is a single block too
+    if( n>1 && size_t(n) >= internal::policy_serial_cutoff() ) {
+        const bool is_done = execute_root([=]() -> bool {
             Index p = tbb::this_task_arena::max_concurrency();
-            const Index slack = 4;
-            Index tilesize = (n-1)/(slack*p) + 1;
+            chained_scan<T> tiles(n, chained_scan_tilesize(n, p), is_reproducible);
+            if( tiles ) {
+                tbb::parallel_for(size_t(0), std::min(size_t(p), tiles.size()), [&](size_t) {
+                    tiles.run(initial,
+                        [reduce](size_t i, size_t j) mutable { return reduce(Index(i), Index(j - i)); },
+                        combine,
+                        [scan](size_t i, size_t j, const T& prefix) mutable { scan(Index(i), Index(j - i), prefix); });
+                });
+                apex(tiles.total());
+                return true;
+            }
+            // Out of memory for the tiles; a reproducible scan runs them serially, and the two passes need one sum per tile only
+            if( is_reproducible ) {
+                apex(serial_tiled_scan(size_t(n), internal::reproducible_blocksize(), initial,
+                    [reduce](size_t i, size_t j) mutable { return reduce(Index(i), Index(j - i)); },
+                    combine,
+                    [scan](size_t i, size_t j, const T& prefix) mutable { scan(Index(i), Index(j - i), prefix); }));
+                return true;
+            }
+            const Index slack = is_static ? 1 : 4;
+            Index tilesize = is_static || !grainsize ? std::max(grainsize, Index((n-1)/(slack*p) + 1)) : grainsize;
             Index m = (n-1)/tilesize;
             raw_buffer buf((m+1)*sizeof(T));
-            if( buf ) {
-                T* r = static_cast<T*>(buf.get());
-                upsweep(Index(0), Index(m+1), tilesize, r, n-m*tilesize, reduce, combine);
-                // When apex is a no-op and combine has no side effects, a good optimizer
-                // should be able to eliminate all code between here and apex.
-                // Alternatively, provide a default value for apex that can be
-                // recognized by metaprogramming that conditionlly executes the following.
-                size_t k = m+1;
-                T t = r[k-1];
-                while( (k&=k-1) )
-                    t = combine(r[k-1],t);
-                apex(combine(initial,t));
-                downsweep(Index(0), Index(m+1), tilesize, r, n-m*tilesize, initial, combine, scan);
-                return;
-            }
-        }
-        // Fewer than 2 elements in sequence, or out of memory.  Handle has single block.
-        T sum = initial;
-        if(n)
-            sum = combine(sum, reduce(Index(0), n));
-        apex(sum);
-        if(n)
-            scan(Index(0), n, initial);
-    });
+            if( !buf )
+                return false;
+            T* r = static_cast<T*>(buf.get());
+            upsweep(Index(0), Index(m+1), tilesize, r, n-m*tilesize, reduce, combine);
+            // When apex is a no-op and combine has no side effects, a good optimizer
+            // should be able to eliminate all code between here and apex.
+            // Alternatively, provide a default value for apex that can be
+            // recognized by metaprogramming that conditionlly executes the following.
+            size_t k = m+1;
+            T t = r[k-1];
+            while( (k&=k-1) )
+                t = combine(r[k-1],t);
+            apex(combine(initial,t));
+            downsweep(Index(0), Index(m+1), tilesize, r, n-m*tilesize, initial, combine, scan);
+            return true;
+        });
+        if( is_done )
+            return;
+    }
+    // Fewer than 2 elements in sequence, or out of memory.  Handle has single block.
+    T sum = initial;
+    if(n)
+        sum = combine(sum, reduce(Index(0), n));
+    apex(sum);
+    if(n)
+        scan(Index(0), n, initial);
+}
+
+//------------------------------------------------------------------------
+// enqueue
+//------------------------------------------------------------------------
+
+//! Arena that starts the asynchronous algorithms
+/** An algorithm started there still runs in the arena that its policy asks for, if any. */
+inline tbb::task_arena& async_arena() {
+    static tbb::task_arena arena;
+    return arena;
+}
+
+//! Start f() on a thread of the pool without waiting for it
+template<typename F>
+void enqueue(const F& f) {
+    async_arena().enqueue(f);
 }
 
 //------------------------------------------------------------------------
@@ -360,12 +677,25 @@ bool parallel_or( Index first, Index last, Brick f ) {
     parallel_for(first, last, [f, &found](Index i, Index j) {
         if (!found.load(std::memory_order_relaxed) && f(i, j)) {
             found.store(true, std::memory_order_relaxed);
-            tbb::task::self().group()->cancel_group_execution();
+            cancel_execution();
         }}
     );
     return found;
 }
 
+//------------------------------------------------------------------------
+// parallel_invoke
+//------------------------------------------------------------------------
+
+//! Evaluation of f1() and f2(), possibly in parallel
+// wrapper over tbb::parallel_invoke
+template<class F1, class F2>
+void parallel_invoke(F1 f1, F2 f2) {
+    execute_root([&]() {
+        tbb::parallel_invoke(f1, f2);
+    });
+}
+
 //------------------------------------------------------------------------
 // parallel_first
 //------------------------------------------------------------------------
@@ -398,65 +728,9 @@ Index parallel_first( Index first, Index last, Brick f ) {
 // parallel_stable_sort
 //------------------------------------------------------------------------
 
-//------------------------------------------------------------------------
-// stable_sort utilities
-//
-// These are used by parallel implementations but do not depend on them.
-//------------------------------------------------------------------------
-
-//! Destroy sequence [xs,xe)
-struct serial_destroy {
-    template<typename RandomAccessIterator>
-    void operator()(RandomAccessIterator zs, RandomAccessIterator ze) {
-        typedef typename std::iterator_traits<RandomAccessIterator>::value_type T;
-        while(zs!=ze) {
-            --ze;
-            (*ze).~T();
-        }
-    }
-};
-
-//! Merge sequences [xs,xe) and [ys,ye) to output sequence [zs,(xe-xs)+(ye-ys)), using std::move
-template<class RandomAccessIterator1, class RandomAccessIterator2, class RandomAccessIterator3, class Compare>
-void serial_move_merge(RandomAccessIterator1 xs, RandomAccessIterator1 xe, RandomAccessIterator2 ys, RandomAccessIterator2 ye, RandomAccessIterator3 zs, Compare comp) {
-    if(xs!=xe) {
-        if(ys!=ye) {
-            for(;;)
-                if(comp(*ys, *xs)) {
-                    *zs = std::move(*ys);
-                    ++zs;
-                    if(++ys==ye) break;
-                }
-                else {
-                    *zs = std::move(*xs);
-                    ++zs;
-                    if(++xs==xe) goto movey;
-                }
-        }
-        ys = xs;
-        ye = xe;
-    }
-movey:
-    std::move(ys, ye, zs);
-}
-
-template<typename RandomAccessIterator1, typename RandomAccessIterator2>
-void merge_sort_init_temp_buf(RandomAccessIterator1 xs, RandomAccessIterator1 xe, RandomAccessIterator2 zs, bool inplace) {
-    const RandomAccessIterator2 ze = zs + (xe-xs);
-    typedef typename std::iterator_traits<RandomAccessIterator2>::value_type T;
-    if(inplace)
-        // Initialize the temporary buffer
-        for(; zs!=ze; ++zs)
-            new(&*zs) T;
-    else
-        // Initialize the temporary buffer and move keys to it.
-        for(; zs!=ze; ++xs, ++zs)
-            new(&*zs) T(std::move(*xs));
-}
-
+//! Move-merge [xs,xe) and [ys,ye) into zs, splitting the merge in halves run by tbb::parallel_invoke
 template<typename RandomAccessIterator1, typename RandomAccessIterator2, typename RandomAccessIterator3, typename Compare, typename Cleanup>
-class merge_task: public tbb::task {
-    /*override*/tbb::task* execute();
+class merge_task {
     RandomAccessIterator1 xs, xe;
     RandomAccessIterator2 ys, ye;
     RandomAccessIterator3 zs;
@@ -469,10 +743,11 @@ public:
                 Compare comp_, Cleanup cleanup_) :
         xs(xs_), xe(xe_), ys(ys_), ye(ye_), zs(zs_), comp(comp_), cleanup(cleanup_)
     {}
+    void operator()() const;
 };
 
 template<typename RandomAccessIterator1, typename RandomAccessIterator2, typename RandomAccessIterator3, typename Compare, typename Cleanup>
-tbb::task* merge_task<RandomAccessIterator1, RandomAccessIterator2, RandomAccessIterator3, Compare, Cleanup>::execute() {
+void merge_task<RandomAccessIterator1, RandomAccessIterator2, RandomAccessIterator3, Compare, Cleanup>::operator()() const {
     const size_t MERGE_CUT_OFF = 2000;
     const auto n = (xe-xs) + (ye-ys);
     if(n <= MERGE_CUT_OFF) {
@@ -481,7 +756,6 @@ tbb::task* merge_task<RandomAccessIterator1, RandomAccessIterator2, RandomAccess
         //we clean the buffer one time on last step of the sort
         cleanup(xs, xe);
         cleanup(ys, ye);
-        return NULL;
     }
     else {
         RandomAccessIterator1 xm;
@@ -495,19 +769,18 @@ tbb::task* merge_task<RandomAccessIterator1, RandomAccessIterator2, RandomAccess
             ym = std::lower_bound(ys, ye, *xm, comp);
         }
         const RandomAccessIterator3 zm = zs + ((xm-xs) + (ym-ys));
-        tbb::task* right = new(allocate_additional_child_of(*parent()))
-            merge_task(xm, xe, ym, ye, zm, comp, cleanup);
-        spawn(*right);
-        recycle_as_continuation();
-        xe = xm;
-        ye = ym;
+        tbb::parallel_invoke(
+            merge_task(xs, xm, ys, ym, zs, comp, cleanup),
+            merge_task(xm, xe, ym, ye, zm, comp, cleanup)
+        );
     }
-    return this;
 }
 
+//! Sort both halves of [xs,xe) with tbb::parallel_invoke, then merge them
+/** inplace==2 leaves the result in [xs,xe) and destroys the elements in the buffer;
+    otherwise inplace tells whether the result goes to [xs,xe) or to the buffer at zs. */
 template<typename RandomAccessIterator1, typename RandomAccessIterator2, typename Compare, typename LeafSort>
-class stable_sort_task : public tbb::task {
-    /*override*/tbb::task* execute();
+class stable_sort_task {
     RandomAccessIterator1 xs, xe;
     RandomAccessIterator2 zs;
     Compare comp;
@@ -515,56 +788,98 @@ class stable_sort_task : public tbb::task {
     int32_t inplace;
 public:
     stable_sort_task(RandomAccessIterator1 xs_, RandomAccessIterator1 xe_, RandomAccessIterator2 zs_, int32_t inplace_, Compare comp_, LeafSort leaf_sort_ ) :
-        xs(xs_), xe(xe_), zs(zs_), inplace(inplace_), comp(comp_), leaf_sort(leaf_sort_)
+        xs(xs_), xe(xe_), zs(zs_), comp(comp_), leaf_sort(leaf_sort_), inplace(inplace_)
     {}
+    void operator()() const;
 };
 
-//! Binary operator that does nothing
-struct binary_no_op {
-    template<typename T>
-    void operator()(T, T) {}
-};
-
-const size_t STABLE_SORT_CUT_OFF = 500;
 
 template<typename RandomAccessIterator1, typename RandomAccessIterator2, typename Compare, typename LeafSort>
-tbb::task* stable_sort_task<RandomAccessIterator1, RandomAccessIterator2, Compare, LeafSort>::execute() {
-        if( xe - xs <= STABLE_SORT_CUT_OFF ) {
-            leaf_sort(xs, xe, comp);
-            if( inplace!=2 )
-                merge_sort_init_temp_buf(xs, xe, zs, inplace!=0);
-            return NULL;
-        } else {
-            const RandomAccessIterator1 xm = xs + (xe - xs) / 2;
-            const RandomAccessIterator2 zm = zs + (xm - xs);
-            const RandomAccessIterator2 ze = zs + (xe - xs);
-            task* m;
-            if (inplace == 2)
-                m = new (allocate_continuation()) merge_task<RandomAccessIterator2,RandomAccessIterator2,RandomAccessIterator1,Compare, serial_destroy>(zs, zm, zm, ze, xs, comp, serial_destroy());
-            else if (inplace)
-                m = new (allocate_continuation()) merge_task<RandomAccessIterator2,RandomAccessIterator2,RandomAccessIterator1,Compare, binary_no_op>(zs, zm, zm, ze, xs, comp, binary_no_op());
-            else
-                m = new (allocate_continuation()) merge_task<RandomAccessIterator1,RandomAccessIterator1,RandomAccessIterator2,Compare, binary_no_op>(xs, xm, xm, xe, zs, comp, binary_no_op());
-            m->set_ref_count(2);
-            task* right = new(m->allocate_child()) stable_sort_task(xm,xe,zm,!inplace, comp, leaf_sort);
-            spawn(*right);
-            recycle_as_child_of(*m);
-            xe=xm;
-            inplace=!inplace;
+void stable_sort_task<RandomAccessIterator1, RandomAccessIterator2, Compare, LeafSort>::operator()() const {
+    if( xe - xs <= STABLE_SORT_CUT_OFF ) {
+        leaf_sort(xs, xe, comp);
+        if( inplace!=2 )
+            merge_sort_init_temp_buf(xs, xe, zs, inplace!=0);
+    } else {
+        const RandomAccessIterator1 xm = xs + (xe - xs) / 2;
+        const RandomAccessIterator2 zm = zs + (xm - xs);
+        const RandomAccessIterator2 ze = zs + (xe - xs);
+        tbb::parallel_invoke(
+            stable_sort_task(xs, xm, zs, !inplace, comp, leaf_sort),
+            stable_sort_task(xm, xe, zm, !inplace, comp, leaf_sort)
+        );
+        if (inplace == 2)
+            merge_task<RandomAccessIterator2,RandomAccessIterator2,RandomAccessIterator1,Compare, serial_destroy>(zs, zm, zm, ze, xs, comp, serial_destroy())();
+        else if (inplace)
+            merge_task<RandomAccessIterator2,RandomAccessIterator2,RandomAccessIterator1,Compare, binary_no_op>(zs, zm, zm, ze, xs, comp, binary_no_op())();
+        else
+            merge_task<RandomAccessIterator1,RandomAccessIterator1,RandomAccessIterator2,Compare, binary_no_op>(xs, xm, xm, xe, zs, comp, binary_no_op())();
+    }
+}
+
+
+//------------------------------------------------------------------------
+// multiway merge
+//
+// For many threads, the chunks sorted by the threads are combined with one
+// k-way merge instead of the top log2(k) levels of binary merges, so that
+// the top of the sort streams the data through memory once.
+//------------------------------------------------------------------------
+
+//! Sort [xs, xe) as k chunks with stable_sort_task, then combine them with one parallel multiway merge
+/** zs is raw memory for xe-xs elements. */
+template<typename RandomAccessIterator, typename T, typename Compare, typename LeafSort>
+void multiway_stable_sort( RandomAccessIterator xs, RandomAccessIterator xe, T* zs, size_t k, Compare comp, LeafSort leaf_sort ) {
+    const size_t n = xe - xs;
+    std::vector<T*> chunk(k + 1);
+    for( size_t i = 0; i <= k; ++i )
+        chunk[i] = zs + i*n/k;
+    // Sort each chunk into the buffer
+    parallel_for(size_t(0), k, [=, &chunk](size_t i, size_t j) {
+        for( ; i != j; ++i )
+            stable_sort_task<RandomAccessIterator,T*,Compare,LeafSort>(
+                xs + (chunk[i] - zs), xs + (chunk[i+1] - zs), chunk[i], 0, comp, leaf_sort )();
+    });
+    // Split the output into k parts of equal size
+    std::vector<size_t> split((k + 1)*k);
+    for( size_t j = 0; j < k; ++j ) {
+        split[j] = 0;
+        split[k*k + j] = chunk[j+1] - chunk[j];
+    }
+    parallel_for(size_t(1), k, [=, &chunk, &split](size_t i, size_t j) {
+        for( ; i != j; ++i )
+            multiway_select(&chunk[0], &chunk[1], k, i*n/k, &split[i*k], comp);
+    });
+    // Merge the parts back into the sequence
+    parallel_for(size_t(0), k, [=, &chunk, &split](size_t i, size_t j) {
+        std::vector<T*> first(k), last(k);
+        for( ; i != j; ++i ) {
+            for( size_t r = 0; r < k; ++r ) {
+                first[r] = chunk[r] + split[i*k + r];
+                last[r] = chunk[r] + split[(i+1)*k + r];
+            }
+            serial_multiway_move_merge(&first[0], &last[0], k, xs + i*n/k, comp);
         }
-    return this;
+    });
+    parallel_for(size_t(0), k, [&chunk](size_t i, size_t j) {
+        for( ; i != j; ++i )
+            serial_destroy()(chunk[i], chunk[i+1]);
+    });
 }
 
 template<typename RandomAccessIterator, typename Compare, typename LeafSort>
 void parallel_stable_sort( RandomAccessIterator xs, RandomAccessIterator xe, Compare comp, LeafSort leaf_sort ) {
-    tbb::this_task_arena::isolate([=](){
+    execute_root([=](){
         typedef typename std::iterator_traits<RandomAccessIterator>::value_type T;
         if( xe-xs > STABLE_SORT_CUT_OFF ) {
             raw_buffer buf( sizeof(T)*(xe-xs) );
             if( buf ) {
-                using tbb::task;
                 typedef typename std::iterator_traits<RandomAccessIterator>::value_type T;
-                task::spawn_root_and_wait(*new( task::allocate_root() ) stable_sort_task<RandomAccessIterator,T*,Compare,LeafSort>( xs, xe, (T*)buf.get(), 2, comp, leaf_sort ));
+                const size_t k = max_concurrency();
+                if( k >= MULTIWAY_MERGE_MIN_WAYS && size_t(xe-xs) >= k*MULTIWAY_MERGE_MIN_CHUNK )
+                    multiway_stable_sort( xs, xe, (T*)buf.get(), k, comp, leaf_sort );
+                else
+                    stable_sort_task<RandomAccessIterator,T*,Compare,LeafSort>( xs, xe, (T*)buf.get(), 2, comp, leaf_sort )();
                 return;
             }
         }
@@ -0,0 +1,381 @@
+/*
+    Copyright (c) 2017 Intel Corporation
+
+    Licensed under the Apache License, Version 2.0 (the "License");
+    you may not use this file except in compliance with the License.
+    You may obtain a copy of the License at
+
+        http://www.apache.org/licenses/LICENSE-2.0
+
+    Unless required by applicable law or agreed to in writing, software
+    distributed under the License is distributed on an "AS IS" BASIS,
+    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+    See the License for the specific language governing permissions and
+    limitations under the License.
+
+
+
+
+*/
+
+#ifndef __PSTL_parallel_impl_thread_H
+#define __PSTL_parallel_impl_thread_H
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "parallel_settings.h"
+// This header defines the minimum set of parallel routines required to support Parallel STL,
+// implemented on top of a work-stealing pool of std::thread, with no dependency beyond
+// the C++11 standard library
+
+namespace pstl {
+namespace par_backend {
+
+//! Task that may be stolen by another thread of the pool
+class stealable_task {
+public:
+    virtual void execute() = 0;
+protected:
+    ~stealable_task() {}
+};
+
+//! Work-stealing deque (D. Chase, Y. Lev, "Dynamic circular work-stealing deque", SPAA '05)
+/** The owner thread pushes and pops tasks at the bottom, the other threads steal them at the top.
+    Memory orders follow N. M. Le et al., "Correct and efficient work-stealing for weak memory models", PPoPP '13.
+    The capacity is fixed, since the fork-join recursion only keeps a task per level in the deque;
+    push fails when the deque is full. */
+class work_stealing_deque {
+    static const int64_t capacity = 256;
+    std::atomic<int64_t> my_top;
+    char my_pad[64 - sizeof(std::atomic<int64_t>)];  // Keep the ends of the deque in different cache lines
+    std::atomic<int64_t> my_bottom;
+    std::atomic<stealable_task*> my_tasks[capacity];
+    work_stealing_deque(const work_stealing_deque&) = delete;
+    void operator=(const work_stealing_deque&) = delete;
+public:
+    work_stealing_deque(): my_top(0), my_bottom(0) {
+        for( int64_t i = 0; i < capacity; ++i )
+            my_tasks[i].store(NULL, std::memory_order_relaxed);
+    }
+    //! Push a task at the bottom; called by the owner only. Return false if the deque is full.
+    bool push(stealable_task* task) {
+        const int64_t b = my_bottom.load(std::memory_order_relaxed);
+        const int64_t t = my_top.load(std::memory_order_acquire);
+        if( b - t >= capacity )
+            return false;
+        my_tasks[b % capacity].store(task, std::memory_order_relaxed);
+        my_bottom.store(b + 1, std::memory_order_release);
+        return true;
+    }
+    //! Pop the task at the bottom; called by the owner only. Return NULL if it was stolen.
+    stealable_task* pop() {
+        const int64_t b = my_bottom.load(std::memory_order_relaxed) - 1;
+        my_bottom.store(b, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        int64_t t = my_top.load(std::memory_order_relaxed);
+        stealable_task* task = NULL;
+        if( t <= b ) {
+            task = my_tasks[b % capacity].load(std::memory_order_relaxed);
+            if( t == b ) {
+                // Last task: race against the thieves for it
+                if( !my_top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed) )
+                    task = NULL;
+                my_bottom.store(b + 1, std::memory_order_relaxed);
+            }
+        }
+        else
+            my_bottom.store(b + 1, std::memory_order_relaxed);
+        return task;
+    }
+    //! Steal the task at the top. Return NULL if the deque is empty or another thread took the task.
+    stealable_task* steal() {
+        int64_t t = my_top.load(std::memory_order_acquire);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        const int64_t b = my_bottom.load(std::memory_order_acquire);
+        if( t >= b )
+            return NULL;
+        stealable_task* const task = my_tasks[t % capacity].load(std::memory_order_relaxed);
+        if( !my_top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed) )
+            return NULL;
+        return task;
+    }
+};
+
+//! Number of threads that execute the parallel algorithms, including the thread that calls them
+/** Defaults to the number of hardware threads; can be set with the environment variable PSTL_NUM_THREADS. */
+inline size_t default_concurrency() {
+    if( const char* s = std::getenv("PSTL_NUM_THREADS") ) {
+        const long n = std::strtol(s, NULL, 10);
+        if( n > 0 )
+            return size_t(n);
+    }
+    const size_t n = std::thread::hardware_concurrency();
+    return n ? n : 1;
+}
+
+//! Pool of worker threads that steal tasks from each other and from the threads that started the algorithms
+/** The deques of the workers are followed by a few deques for the external threads. An external thread
+    without a free deque executes its algorithm serially. The workers look for tasks only while
+    some algorithm runs, and sleep otherwise.
+
+    Each external slot is the root of the algorithm started by its thread. A worker joins one root at
+    a time, if the root has fewer members than the concurrency limit of its policy, and steals only from
+    the deques of the members of that root. */
+class thread_pool {
+    //! Number of external threads that can run parallel algorithms at the same time
+    static const size_t external_slots = 8;
+    //! Value of my_root for the deque of a worker that does not belong to any root
+    static const size_t no_root = ~size_t(0);
+
+    size_t my_num_workers;
+    std::unique_ptr<work_stealing_deque[]> my_deques;
+    //! Root served by the owner of each deque
+    std::unique_ptr<std::atomic<size_t>[]> my_root;
+    std::unique_ptr<std::atomic<bool>[]> my_slot_busy;
+    //! Concurrency limit of each root
+    std::unique_ptr<std::atomic<size_t>[]> my_limit;
+    //! Number of threads that serve each root
+    std::unique_ptr<std::atomic<size_t>[]> my_members;
+    std::vector<std::thread> my_threads;
+    std::atomic<size_t> my_active;
+    bool my_stop;
+    std::mutex my_mutex;
+    std::condition_variable my_wakeup;
+
+    size_t num_deques() const { return my_num_workers + external_slots; }
+
+    //! Join a root that has room for one more thread; return no_root if there is none.
+    size_t join(size_t index, size_t& start) {
+        for( size_t i = 0; i < external_slots; ++i ) {
+            const size_t r = (start + i) % external_slots;
+            if( !my_slot_busy[r].load(std::memory_order_acquire) )
+                continue;
+            size_t m = my_members[r].load(std::memory_order_relaxed);
+            while( m < my_limit[r].load(std::memory_order_relaxed) )
+                if( my_members[r].compare_exchange_weak(m, m + 1) ) {
+                    my_root[index].store(r, std::memory_order_relaxed);
+                    start = r + 1;
+                    return r;
+                }
+        }
+        return no_root;
+    }
+
+    void leave(size_t index, size_t root) {
+        my_root[index].store(no_root, std::memory_order_relaxed);
+        my_members[root].fetch_sub(1);
+    }
+
+    void worker(size_t index) {
+        current_deque() = &my_deques[index];
+        size_t victim = index, start = index;
+        for(;;) {
+            {
+                std::unique_lock<std::mutex> lock(my_mutex);
+                my_wakeup.wait(lock, [this]() { return my_stop || my_active.load(std::memory_order_relaxed) > 0; });
+                if( my_stop )
+                    return;
+            }
+            while( my_active.load(std::memory_order_relaxed) > 0 ) {
+                const size_t root = join(index, start);
+                if( root != no_root ) {
+                    while( stealable_task* task = steal(victim, root) )
+                        task->execute();
+                    // The deque of the worker is empty, since each task waits for the tasks it spawns
+                    leave(index, root);
+                }
+                std::this_thread::yield();
+            }
+        }
+    }
+
+    thread_pool(const thread_pool&) = delete;
+    void operator=(const thread_pool&) = delete;
+public:
+    explicit thread_pool(size_t concurrency):
+        my_num_workers(concurrency - 1),
+        my_deques(new work_stealing_deque[concurrency - 1 + external_slots]),
+        my_root(new std::atomic<size_t>[concurrency - 1 + external_slots]),
+        my_slot_busy(new std::atomic<bool>[external_slots]),
+        my_limit(new std::atomic<size_t>[external_slots]),
+        my_members(new std::atomic<size_t>[external_slots]),
+        my_active(0),
+        my_stop(false)
+    {
+        for( size_t i = 0; i < num_deques(); ++i )
+            my_root[i].store(no_root, std::memory_order_relaxed);
+        for( size_t i = 0; i < external_slots; ++i ) {
+            my_slot_busy[i].store(false, std::memory_order_relaxed);
+            my_limit[i].store(0, std::memory_order_relaxed);
+            my_members[i].store(0, std::memory_order_relaxed);
+        }
+        for( size_t i = 0; i < my_num_workers; ++i )
+            my_threads.push_back(std::thread([this, i]() { worker(i); }));
+    }
+
+    ~thread_pool() {
+        {
+            std::lock_guard<std::mutex> lock(my_mutex);
+            my_stop = true;
+        }
+        my_wakeup.notify_all();
+        for( size_t i = 0; i < my_threads.size(); ++i )
+            my_threads[i].join();
+    }
+
+    static thread_pool& instance() {
+        static thread_pool pool(default_concurrency());
+        return pool;
+    }
+
+    //! The deque of the calling thread, or NULL if it does not belong to the pool
+    static work_stealing_deque*& current_deque() {
+        static thread_local work_stealing_deque* deque = NULL;
+        return deque;
+    }
+
+    size_t concurrency() const { return my_num_workers + 1; }
+
+    //! Number of threads that may execute the algorithm of the calling thread
+    /** It is the limit of the root that the thread serves, or of the policy of the algorithm that it starts. */
+    size_t limit() const {
+        if( work_stealing_deque* const deque = current_deque() ) {
+            const size_t root = my_root[deque - &my_deques[0]].load(std::memory_order_relaxed);
+            if( root != no_root )
+                return my_limit[root].load(std::memory_order_relaxed);
+        }
+        const internal::parallel_settings* settings = internal::current_parallel_settings();
+        if( settings && settings->concurrency && settings->concurrency < concurrency() )
+            return settings->concurrency;
+        return concurrency();
+    }
+
+    //! Obtain a deque for an external thread and wake up the workers; return NULL if none is free.
+    /** At most limit threads, including the external one, execute the tasks spawned to the deque. */
+    work_stealing_deque* acquire_slot(size_t limit) {
+        if( limit < 2 )
+            return NULL;
+        for( size_t i = 0; i < external_slots; ++i ) {
+            bool busy = false;
+            if( my_slot_busy[i].compare_exchange_strong(busy, true) ) {
+                // Workers that have not yet left the previous root of the slot remain its members
+                my_limit[i].store(limit, std::memory_order_relaxed);
+                my_members[i].fetch_add(1);
+                my_root[my_num_workers + i].store(i, std::memory_order_relaxed);
+                {
+                    std::lock_guard<std::mutex> lock(my_mutex);
+                    my_active.fetch_add(1, std::memory_order_relaxed);
+                }
+                my_wakeup.notify_all();
+                return &my_deques[my_num_workers + i];
+            }
+        }
+        return NULL;
+    }
+
+    void release_slot(work_stealing_deque* deque) {
+        const size_t i = deque - &my_deques[my_num_workers];
+        my_active.fetch_sub(1, std::memory_order_relaxed);
+        my_root[my_num_workers + i].store(no_root, std::memory_order_relaxed);
+        my_members[i].fetch_sub(1);
+        my_slot_busy[i].store(false, std::memory_order_release);
+    }
+
+    //! Steal a task from the deques of the other members of root, starting after victim
+    stealable_task* steal(size_t& victim, size_t root) {
+        work_stealing_deque* const own = current_deque();
+        for( size_t i = 0; i < num_deques(); ++i ) {
+            victim = (victim + 1) % num_deques();
+            work_stealing_deque* const deque = &my_deques[victim];
+            if( deque != own && my_root[victim].load(std::memory_order_relaxed) == root )
+                if( stealable_task* task = deque->steal() )
+                    return task;
+        }
+        return NULL;
+    }
+
+    //! Execute stolen tasks of the root of the calling thread until task is done
+    template<typename Task>
+    void wait(const Task& task) {
+        const size_t root = my_root[current_deque() - &my_deques[0]].load(std::memory_order_relaxed);
+        size_t victim = 0;
+        while( !task.is_done() ) {
+            if( stealable_task* t = steal(victim, root) )
+                t->execute();
+            else
+                std::this_thread::yield();
+        }
+    }
+};
+
+//! Task that executes context.run(f) for invoke_tasks
+template<typename Context, typename F>
+class invoke_task: public stealable_task {
+    Context& my_context;
+    const F& my_f;
+    std::atomic<bool> my_done;
+public:
+    invoke_task(Context& context, const F& f): my_context(context), my_f(f), my_done(false) {}
+    /*override*/ void execute() {
+        my_context.run(my_f);
+        // The task may be destroyed as soon as it is done
+        my_done.store(true, std::memory_order_release);
+    }
+    bool is_done() const { return my_done.load(std::memory_order_acquire); }
+};
+
+//! Number of threads that can execute the parallel algorithms
+inline size_t max_concurrency() {
+    return thread_pool::instance().limit();
+}
+
+//! Execute f() with the deque of the calling thread, or with a deque acquired from the pool for an external thread
+template<typename F>
+void execute_root(const F& f) {
+    work_stealing_deque*& deque = thread_pool::current_deque();
+    if( deque ) {
+        // Nested algorithm
+        f();
+        return;
+    }
+    thread_pool& pool = thread_pool::instance();
+    deque = pool.acquire_slot(pool.limit());
+    f();
+    if( deque ) {
+        pool.release_slot(deque);
+        deque = NULL;
+    }
+}
+
+//! Execute f1() and f2() in context, the former as a task that other threads may steal, and wait for both
+template<typename Context, typename F1, typename F2>
+void invoke_tasks(Context& context, const F1& f1, const F2& f2) {
+    work_stealing_deque* const deque = thread_pool::current_deque();
+    invoke_task<Context, F1> task(context, f1);
+    if( !deque || !deque->push(&task) ) {
+        context.run(f1);
+        context.run(f2);
+        return;
+    }
+    context.run(f2);
+    // The tasks spawned by f2 were joined, so the task is at the bottom unless it was stolen
+    if( deque->pop() )
+        task.execute();
+    else
+        thread_pool::instance().wait(task);
+}
+
+} // namespace par_backend
+} // namespace pstl
+
+#include "parallel_backend_fork_join.h"
+
+#endif /* __PSTL_parallel_impl_thread_H */
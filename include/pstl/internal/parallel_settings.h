@@ -0,0 +1,199 @@
+/*
+    Copyright (c) 2017 Intel Corporation
+
+    Licensed under the Apache License, Version 2.0 (the "License");
+    you may not use this file except in compliance with the License.
+    You may obtain a copy of the License at
+
+        http://www.apache.org/licenses/LICENSE-2.0
+
+    Unless required by applicable law or agreed to in writing, software
+    distributed under the License is distributed on an "AS IS" BASIS,
+    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+    See the License for the specific language governing permissions and
+    limitations under the License.
+
+
+
+
+*/
+
+#ifndef __PSTL_parallel_settings_H
+#define __PSTL_parallel_settings_H
+
+#include <atomic>
+#include <cstddef>
+#include <type_traits>
+
+#include "pstl_config.h"
+
+#if __PSTL_USE_TBB
+#include <tbb/partitioner.h>
+#include <tbb/task_arena.h>
+#endif
+
+namespace pstl {
+namespace execution {
+inline namespace v1 {
+
+//! How a parallel policy splits the iteration space of an algorithm into chunks
+enum class partitioner {
+    //! Split the chunks further while threads are idle (the default)
+    auto_,
+    //! Split the iteration space evenly among the threads, for bodies of uniform cost
+    static_
+};
+
+//! Chunk-to-thread mapping that a parallel policy replays in each algorithm it executes
+/** Pass the same object to policy.with_affinity() for repeated sweeps over the same data,
+    so that each chunk goes to the thread that has it in cache from the previous sweep.
+    The TBB backend records the mapping with tbb::affinity_partitioner; the other backends
+    split the iteration space evenly among the threads, as partitioner::static_ does.
+    If concurrent algorithms use the same object, only one of them replays the mapping. */
+class affinity {
+#if __PSTL_USE_TBB
+    tbb::affinity_partitioner my_partitioner;
+#endif
+    std::atomic<bool> my_busy;
+    affinity(const affinity&) = delete;
+    void operator=(const affinity&) = delete;
+public:
+    affinity(): my_busy(false) {}
+
+    // For internal use only
+    bool __try_acquire() { return !my_busy.exchange(true, std::memory_order_acquire); }
+    void __release() { my_busy.store(false, std::memory_order_release); }
+#if __PSTL_USE_TBB
+    tbb::affinity_partitioner& __partitioner() { return my_partitioner; }
+#endif
+};
+
+} // namespace v1
+} // namespace execution
+
+namespace internal {
+
+//! Run-time settings of a parallel policy, applied by the threading backend
+struct parallel_settings {
+    //! Maximal number of threads that execute the algorithm; 0 means no limit
+    std::size_t concurrency;
+    //! Number of elements in a chunk; 0 lets the backend choose
+    std::size_t grainsize;
+    //! How the iteration space is split into chunks of at least grainsize elements
+    execution::partitioner partitioning;
+    //! Mapping of chunks to threads replayed by the algorithm, or NULL
+    execution::affinity* affinity_state;
+    //! Whether the algorithm runs contiguous slices of the iteration space on the NUMA nodes
+    bool numa_placement;
+    //! Ranges with fewer elements run serially
+    std::size_t serial_cutoff;
+    //! Whether the algorithm times a serial sample of the range to decide whether to run the rest serially
+    bool auto_cutoff;
+    //! Whether the reductions and scans combine fixed blocks of the range in a fixed order
+    bool reproducible;
+#if __PSTL_USE_TBB
+    //! Arena that executes the algorithm, or NULL for the arena of the calling thread
+    tbb::task_arena* arena;
+#endif
+
+    parallel_settings():
+        concurrency(0),
+        grainsize(0),
+        partitioning(execution::partitioner::auto_),
+        affinity_state(NULL),
+        numa_placement(false),
+        serial_cutoff(__PSTL_SERIAL_CUTOFF),
+        auto_cutoff(false),
+        reproducible(false)
+#if __PSTL_USE_TBB
+        , arena(NULL)
+#endif
+    {}
+};
+
+//! Settings of the policy whose algorithm the calling thread executes, or NULL
+inline const parallel_settings*& current_parallel_settings() {
+    static thread_local const parallel_settings* settings = NULL;
+    return settings;
+}
+
+//! Chunk size requested by the policy of the algorithm, or 0 if the backend chooses it
+inline std::size_t policy_grainsize() {
+    const parallel_settings* settings = current_parallel_settings();
+    return settings ? settings->grainsize : 0;
+}
+
+//! True if the policy of the algorithm asks for one chunk per thread
+/** A policy with affinity asks for it too, for the backends that cannot replay a mapping. */
+inline bool static_partitioning() {
+    const parallel_settings* settings = current_parallel_settings();
+    return settings && (settings->partitioning == execution::partitioner::static_ || settings->affinity_state);
+}
+
+//! Affinity requested by the policy of the algorithm, or NULL
+inline execution::affinity* policy_affinity() {
+    const parallel_settings* settings = current_parallel_settings();
+    return settings ? settings->affinity_state : NULL;
+}
+
+//! True if the policy of the algorithm asks to run contiguous slices of the iteration space on the NUMA nodes
+inline bool numa_placement() {
+    const parallel_settings* settings = current_parallel_settings();
+    return settings && settings->numa_placement;
+}
+
+//! True if the policy of the algorithm asks for results that do not depend on the number of threads
+inline bool reproducible() {
+    const parallel_settings* settings = current_parallel_settings();
+    return settings && settings->reproducible;
+}
+
+//! Number of elements of the blocks that a reproducible reduction or scan combines in a fixed order
+inline std::size_t reproducible_blocksize() {
+    const std::size_t grainsize = policy_grainsize();
+    return grainsize ? grainsize : __PSTL_REPRODUCIBLE_BLOCK;
+}
+
+//! Number of elements below which the algorithm runs serially
+/** A reproducible algorithm runs serially the ranges of one block, and only them. */
+inline std::size_t policy_serial_cutoff() {
+    const parallel_settings* settings = current_parallel_settings();
+    if( settings && settings->reproducible )
+        return reproducible_blocksize() + 1;
+    return settings ? settings->serial_cutoff : __PSTL_SERIAL_CUTOFF;
+}
+
+//! True if the policy of the algorithm asks to decide on a serial run by timing a sample of the range
+inline bool auto_serial_cutoff() {
+    const parallel_settings* settings = current_parallel_settings();
+    return settings && settings->auto_cutoff && !settings->reproducible;
+}
+
+//! Parallelization tag that makes the settings current while the algorithm runs
+/** The policy returns it from __allow_parallel(), so it lives until the end of the
+    full-expression that calls the pattern, or of the scope of the variable it initializes.
+    Only the object that made the settings current restores the previous ones;
+    copies, such as the std::true_type passed to the patterns, do not. */
+class parallel_settings_scope: public std::true_type {
+    const parallel_settings* my_saved;
+    bool my_owner;
+    void operator=(const parallel_settings_scope&) = delete;
+public:
+    explicit parallel_settings_scope(const parallel_settings& settings):
+        my_saved(current_parallel_settings()), my_owner(true) {
+        current_parallel_settings() = &settings;
+    }
+    parallel_settings_scope(const parallel_settings_scope& other): my_saved(other.my_saved), my_owner(false) {}
+    parallel_settings_scope(parallel_settings_scope&& other): my_saved(other.my_saved), my_owner(other.my_owner) {
+        other.my_owner = false;
+    }
+    ~parallel_settings_scope() {
+        if( my_owner )
+            current_parallel_settings() = my_saved;
+    }
+};
+
+} // namespace internal
+} // namespace pstl
+
+#endif /* __PSTL_parallel_settings_H */
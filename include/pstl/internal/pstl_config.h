@@ -48,12 +48,41 @@
 #define __PSTL_USE_PAR_POLICIES 1
 #endif
 
+// Intel TBB is the default threading backend; __PSTL_USE_OMP selects OpenMP and
+// __PSTL_USE_THREAD the work-stealing pool of std::thread instead.
+// Without Intel TBB headers the default is the std::thread backend.
 #if __PSTL_USE_PAR_POLICIES
-#if !defined(__PSTL_USE_TBB)
+#if !defined(__PSTL_USE_TBB) && !defined(__PSTL_USE_OMP) && !defined(__PSTL_USE_THREAD)
+#if defined(__has_include)
+#if __has_include(<tbb/task_arena.h>)
 #define __PSTL_USE_TBB 1
+#else
+#define __PSTL_USE_THREAD 1
+#endif
+#else
+#define __PSTL_USE_TBB 1
+#endif
 #endif
 #else
 #undef __PSTL_USE_TBB
+#undef __PSTL_USE_OMP
+#undef __PSTL_USE_THREAD
+#endif
+
+// Ranges with fewer elements than PSTL_SERIAL_CUTOFF run serially in the parallel algorithms,
+// unless the policy sets its own cutoff with with_serial_cutoff() or with_auto_cutoff().
+#if defined(PSTL_SERIAL_CUTOFF)
+#define __PSTL_SERIAL_CUTOFF PSTL_SERIAL_CUTOFF
+#elif !defined(__PSTL_SERIAL_CUTOFF)
+#define __PSTL_SERIAL_CUTOFF 0
+#endif
+
+// Number of elements of the leaf blocks of the reductions and scans with policy.with_reproducible(),
+// unless the policy sets its own chunk size with with_chunk().
+#if defined(PSTL_REPRODUCIBLE_BLOCK)
+#define __PSTL_REPRODUCIBLE_BLOCK PSTL_REPRODUCIBLE_BLOCK
+#elif !defined(__PSTL_REPRODUCIBLE_BLOCK)
+#define __PSTL_REPRODUCIBLE_BLOCK 4096
 #endif
 
 // Portability "#pragma" definition
@@ -89,6 +118,8 @@
 #define __PSTL_CPP14_2RANGE_MISMATCH_EQUAL_PRESENT (_MSC_VER >= 1900 || __cplusplus >= 201300L || __cpp_lib_robust_nonmodifying_seq_ops == 201304)
 #define __PSTL_CPP14_MAKE_REVERSE_ITERATOR_PRESENT (_MSC_VER >= 1900 || __cplusplus >= 201402L || __cpp_lib_make_reverse_iterator == 201402)
 #define __PSTL_CPP14_INTEGER_SEQUENCE_PRESENT (_MSC_VER >= 1900 || __cplusplus >= 201402L)
+#define __PSTL_CPP14_TRANSPARENT_COMPARATORS_PRESENT (_MSC_VER >= 1800 || __cplusplus >= 201402L)
+#define __PSTL_CPP17_STRING_VIEW_PRESENT (_MSVC_LANG >= 201703L || __cplusplus >= 201703L)
 #define __PSTL_CPP14_VARIABLE_TEMPLATES_PRESENT \
     (!__INTEL_COMPILER || __INTEL_COMPILER >= 1700) && (_MSC_FULL_VER >= 190023918 || __cplusplus >= 201402L)
 
@@ -109,6 +140,9 @@
 #define __PSTL_PRAGMA_SIMD_ORDERED_MONOTONIC_2ARGS(PRM1, PRM2)
 #endif
 
+// The scans of arithmetic values are computed in registers with AVX2 intrinsics
+#define __PSTL_SIMD_SCAN_AVX2_PRESENT (__AVX2__)
+
 #if (__INTEL_COMPILER >= 1600)
 #define __PSTL_PRAGMA_VECTOR_UNALIGNED __PSTL_PRAGMA(vector unaligned)
 #else
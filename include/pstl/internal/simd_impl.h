@@ -22,38 +22,96 @@
 #define __PSTL_vector_impl_H
 
 #include <algorithm> //for std::min
+#include <iterator>
 #include <type_traits>
+#include <tuple>
 
 #include "pstl_config.h"
 #include "common.h"
 
+#if __PSTL_SIMD_SCAN_AVX2_PRESENT
+#include <immintrin.h>
+#endif
+
 // This header defines the minimum set of vector routines required
 // to support parallel STL.
 namespace pstl {
 namespace internal {
 
+//! Indexed access to the elements of a zip_iterator through its component iterators
+/** zip_iterator::operator[] copies the tuple of iterators and advances each of them, which keeps
+    the loops from vectorizing; this indexes the component iterators, as for separate arrays. */
+template<class... Types>
+class zip_access {
+public:
+    typedef std::tuple<typename std::iterator_traits<Types>::reference...> reference;
+    explicit zip_access(const std::tuple<Types...>& it): my_it(it) {}
+    template<class DifferenceType>
+    reference operator[](DifferenceType i) const { return get(i, make_index_sequence<sizeof...(Types)>()); }
+private:
+    template<class DifferenceType, std::size_t... I>
+    reference get(DifferenceType i, index_sequence<I...>) const { return reference(std::get<I>(my_it)[i]...); }
+    std::tuple<Types...> my_it;
+};
+
+//! Indexed access to the values of a counting_iterator as a plain integer induction variable
+/** counting_iterator::operator[] constructs a temporary iterator and reads its counter through a
+    reference; this computes the value directly, so the loops see an ordinary induction variable. */
+template<class IntType>
+class counting_access {
+public:
+    typedef IntType reference;
+    explicit counting_access(IntType init): my_counter(init) {}
+    template<class DifferenceType>
+    reference operator[](DifferenceType i) const { return my_counter + i; }
+private:
+    IntType my_counter;
+};
+
+//! Object that the SIMD loops index instead of the iterator it
+template<class Iterator>
+Iterator simd_access(Iterator it) noexcept {
+    return it;
+}
+
+template<class IntType>
+counting_access<IntType> simd_access(const counting_iterator<IntType>& it) noexcept {
+    return counting_access<IntType>(*it);
+}
+
+template<class... Types>
+zip_access<Types...> simd_access(const zip_iterator<Types...>& it) noexcept {
+    return zip_access<Types...>(it.base());
+}
+
 template<class Iterator, class DifferenceType, class Function>
 Iterator simd_walk_1(Iterator first, DifferenceType n, Function f) noexcept {
+    const auto x = simd_access(first);
 __PSTL_PRAGMA_SIMD
     for(DifferenceType i = 0; i < n; ++i)
-        f(first[i]);
+        f(x[i]);
 
     return first + n;
 }
 
 template<class Iterator1, class DifferenceType, class Iterator2, class Function>
 Iterator2 simd_walk_2(Iterator1 first1, DifferenceType n, Iterator2 first2, Function f) noexcept {
+    const auto x = simd_access(first1);
+    const auto y = simd_access(first2);
 __PSTL_PRAGMA_SIMD
     for(DifferenceType i = 0; i < n; ++i)
-        f(first1[i], first2[i]);
+        f(x[i], y[i]);
     return first2 + n;
 }
 
 template<class Iterator1, class DifferenceType, class Iterator2, class Iterator3, class Function>
 Iterator3 simd_walk_3(Iterator1 first1, DifferenceType n, Iterator2 first2, Iterator3 first3, Function f) noexcept {
+    const auto x = simd_access(first1);
+    const auto y = simd_access(first2);
+    const auto z = simd_access(first3);
 __PSTL_PRAGMA_SIMD
     for(DifferenceType i = 0; i < n; ++i)
-        f(first1[i], first2[i], first3[i]);
+        f(x[i], y[i], z[i]);
     return first3 + n;
 }
 
@@ -61,20 +119,22 @@ __PSTL_PRAGMA_SIMD
 template<class Index, class DifferenceType, class Pred>
 bool simd_or(Index first, DifferenceType n, Pred pred) noexcept {
 #if __PSTL_EARLYEXIT_PRESENT
+    const auto x = simd_access(first);
     DifferenceType i;
 __PSTL_PRAGMA_SIMD_EARLYEXIT
     for(i = 0; i < n; ++i)
-        if(pred(first[i]))
+        if(pred(x[i]))
             break;
     return i < n;
 #else
     DifferenceType block_size = std::min<DifferenceType>(4, n);
     const Index last = first + n;
     while ( last != first ) {
+        const auto x = simd_access(first);
         int32_t flag = 1;
 __PSTL_PRAGMA_SIMD_REDUCTION(&:flag)
         for ( DifferenceType i = 0; i < block_size; ++i )
-            if ( pred(*(first + i)) )
+            if ( pred(x[i]) )
                 flag = 0;
         if ( !flag )
             return true;
@@ -95,10 +155,11 @@ __PSTL_PRAGMA_SIMD_REDUCTION(&:flag)
 template<class Index, class DifferenceType, class Pred>
 Index simd_first(Index first, DifferenceType n, Pred pred) noexcept {
 #if __PSTL_EARLYEXIT_PRESENT
+    const auto x = simd_access(first);
     DifferenceType i = 0;
 __PSTL_PRAGMA_SIMD_EARLYEXIT
     for(;i < n; ++i)
-        if(pred(*(first+i)))
+        if(pred(x[i]))
             break;
 
     return first + i;
@@ -108,12 +169,13 @@ __PSTL_PRAGMA_SIMD_EARLYEXIT
     const DifferenceType block_size = 8;
     alignas(64) DifferenceType lane[block_size] = {0};
     while ( last - first >= block_size ) {
+        const auto x = simd_access(first);
         DifferenceType found = 0;
 __PSTL_PRAGMA_VECTOR_UNALIGNED // Do not generate peel loop part
 __PSTL_PRAGMA_SIMD_REDUCTION(|:found)
         for ( DifferenceType i = 0; i < block_size; ++i ) {
             // To improve SIMD vectorization
-            const DifferenceType t = (pred(*(first + i)));
+            const DifferenceType t = (pred(x[i]));
             lane[i] = t;
             found |= t;
         }
@@ -141,10 +203,12 @@ __PSTL_PRAGMA_SIMD_REDUCTION(|:found)
 template<class Index1, class DifferenceType, class Index2, class Pred>
 std::pair<Index1, Index2> simd_first(Index1 first1, DifferenceType n, Index2 first2, Pred pred) noexcept {
 #if __PSTL_EARLYEXIT_PRESENT
+    const auto x = simd_access(first1);
+    const auto y = simd_access(first2);
     DifferenceType i = 0;
 __PSTL_PRAGMA_SIMD_EARLYEXIT
     for(;i < n; ++i)
-        if(pred(first1[i], first2[i]))
+        if(pred(x[i], y[i]))
             break;
     return std::make_pair(first1 + i, first2 + i);
 #else
@@ -154,12 +218,14 @@ __PSTL_PRAGMA_SIMD_EARLYEXIT
     const DifferenceType block_size = 8;
     alignas(64) DifferenceType lane[block_size] = {0};
     while ( last1 - first1 >= block_size ) {
+        const auto x = simd_access(first1);
+        const auto y = simd_access(first2);
         DifferenceType found = 0;
         DifferenceType i;
 __PSTL_PRAGMA_VECTOR_UNALIGNED // Do not generate peel loop part
 __PSTL_PRAGMA_SIMD_REDUCTION(|:found)
         for ( i = 0; i < block_size; ++i ) {
-            const DifferenceType t = pred(first1[i], first2[i]);
+            const DifferenceType t = pred(x[i], y[i]);
             lane[i] = t;
             found |= t;
         }
@@ -186,10 +252,11 @@ __PSTL_PRAGMA_SIMD_REDUCTION(|:found)
 
 template<class Index, class DifferenceType, class Pred>
 DifferenceType simd_count(Index first, DifferenceType n, Pred pred) noexcept {
+    const auto x = simd_access(first);
     DifferenceType count = 0;
 __PSTL_PRAGMA_SIMD_REDUCTION(+:count)
     for (DifferenceType i = 0; i < n; ++i)
-        if (pred(*(first + i)))
+        if (pred(x[i]))
             ++count;
 
     return count;
@@ -397,20 +464,312 @@ Index1 simd_search(Index1 first, Index1 last, Index2 s_first, Index2 s_last, Bin
 
 template<typename InputIterator1, typename DifferenceType, typename InputIterator2, typename T, typename BinaryOperation>
 T simd_transform_reduce(InputIterator1 first1, DifferenceType n, InputIterator2 first2, T init, BinaryOperation binary_op) noexcept {
+    const auto x = simd_access(first1);
+    const auto y = simd_access(first2);
 __PSTL_PRAGMA_SIMD_REDUCTION(+:init)
     for(DifferenceType i = 0; i < n; ++i)
-        init += binary_op(first1[i], first2[i]);
+        init += binary_op(x[i], y[i]);
     return init;
 };
 
 template<typename InputIterator, typename DifferenceType, typename T, typename UnaryOperation>
 T simd_transform_reduce(InputIterator first, DifferenceType n, T init, UnaryOperation unary_op) noexcept {
+    const auto x = simd_access(first);
 __PSTL_PRAGMA_SIMD_REDUCTION(+:init)
     for(DifferenceType i = 0; i < n; ++i)
-        init += unary_op(first[i]);
+        init += unary_op(x[i]);
     return init; 
 };
 
+//------------------------------------------------------------------------
+// scan
+//------------------------------------------------------------------------
+
+struct simd_plus_tag {};
+struct simd_min_tag {};
+struct simd_max_tag {};
+
+//! Tag of the operation that binary_op computes on values of type T, for the scans in registers
+template<class BinaryOperation, class T>
+struct simd_scan_tag { typedef void type; };
+
+template<class T>
+struct simd_scan_tag<std::plus<T>, T> { typedef simd_plus_tag type; };
+
+#if __PSTL_CPP14_TRANSPARENT_COMPARATORS_PRESENT
+template<class T>
+struct simd_scan_tag<std::plus<void>, T> { typedef simd_plus_tag type; };
+#endif
+
+template<class T>
+struct simd_scan_tag<pstl::minimum<T>, T> { typedef simd_min_tag type; };
+
+template<class T>
+struct simd_scan_tag<pstl::minimum<void>, T> { typedef simd_min_tag type; };
+
+template<class T>
+struct simd_scan_tag<pstl::maximum<T>, T> { typedef simd_max_tag type; };
+
+template<class T>
+struct simd_scan_tag<pstl::maximum<void>, T> { typedef simd_max_tag type; };
+
+//! Operation Tag on the values of Size bytes held in a register, a(i) op b(i) for each i
+/** a holds the values that come first, so that min and max return the same one as pstl::minimum and pstl::maximum.
+    The integers of 8 bytes are not supported, since the scans of 4 of them in a register are not faster than serial ones. */
+template<class Tag, std::size_t Size, bool IsSigned, bool IsFloat>
+struct simd_scan_op {
+    static const bool is_supported = false;
+};
+
+#if __PSTL_SIMD_SCAN_AVX2_PRESENT
+template<bool IsSigned>
+struct simd_scan_op<simd_plus_tag, 4, IsSigned, false> {
+    static const bool is_supported = true;
+    static __m256i apply(__m256i a, __m256i b) { return _mm256_add_epi32(a, b); }
+};
+
+template<>
+struct simd_scan_op<simd_plus_tag, 4, true, true> {
+    static const bool is_supported = true;
+    static __m256i apply(__m256i a, __m256i b) { return _mm256_castps_si256(_mm256_add_ps(_mm256_castsi256_ps(a), _mm256_castsi256_ps(b))); }
+};
+
+template<>
+struct simd_scan_op<simd_plus_tag, 8, true, true> {
+    static const bool is_supported = true;
+    static __m256i apply(__m256i a, __m256i b) { return _mm256_castpd_si256(_mm256_add_pd(_mm256_castsi256_pd(a), _mm256_castsi256_pd(b))); }
+};
+
+template<>
+struct simd_scan_op<simd_min_tag, 4, true, false> {
+    static const bool is_supported = true;
+    static __m256i apply(__m256i a, __m256i b) { return _mm256_min_epi32(a, b); }
+};
+
+template<>
+struct simd_scan_op<simd_min_tag, 4, false, false> {
+    static const bool is_supported = true;
+    static __m256i apply(__m256i a, __m256i b) { return _mm256_min_epu32(a, b); }
+};
+
+template<>
+struct simd_scan_op<simd_max_tag, 4, true, false> {
+    static const bool is_supported = true;
+    static __m256i apply(__m256i a, __m256i b) { return _mm256_max_epi32(a, b); }
+};
+
+template<>
+struct simd_scan_op<simd_max_tag, 4, false, false> {
+    static const bool is_supported = true;
+    static __m256i apply(__m256i a, __m256i b) { return _mm256_max_epu32(a, b); }
+};
+
+template<>
+struct simd_scan_op<simd_min_tag, 4, true, true> {
+    static const bool is_supported = true;
+    static __m256i apply(__m256i a, __m256i b) { return _mm256_castps_si256(_mm256_min_ps(_mm256_castsi256_ps(b), _mm256_castsi256_ps(a))); }
+};
+
+template<>
+struct simd_scan_op<simd_min_tag, 8, true, true> {
+    static const bool is_supported = true;
+    static __m256i apply(__m256i a, __m256i b) { return _mm256_castpd_si256(_mm256_min_pd(_mm256_castsi256_pd(b), _mm256_castsi256_pd(a))); }
+};
+
+template<>
+struct simd_scan_op<simd_max_tag, 4, true, true> {
+    static const bool is_supported = true;
+    static __m256i apply(__m256i a, __m256i b) { return _mm256_castps_si256(_mm256_max_ps(_mm256_castsi256_ps(b), _mm256_castsi256_ps(a))); }
+};
+
+template<>
+struct simd_scan_op<simd_max_tag, 8, true, true> {
+    static const bool is_supported = true;
+    static __m256i apply(__m256i a, __m256i b) { return _mm256_castpd_si256(_mm256_max_pd(_mm256_castsi256_pd(b), _mm256_castsi256_pd(a))); }
+};
+
+//! Scan in a register of the values of Size bytes by log-step shifts and combinations
+template<class Op, std::size_t Size>
+struct simd_scan_register;
+
+template<class Op>
+struct simd_scan_register<Op, 4> {
+    //! Inclusive scan of the 8 values of x
+    static __m256i scan(__m256i x) {
+        x = _mm256_blend_epi32(x, Op::apply(_mm256_slli_si256(x, 4), x), 0xEE);
+        x = _mm256_blend_epi32(x, Op::apply(_mm256_slli_si256(x, 8), x), 0xCC);
+        // Combine the last value of the low half with the values of the high half
+        const __m256i low = _mm256_shuffle_epi32(_mm256_permute2x128_si256(x, x, 0x08), 0xFF);
+        return _mm256_blend_epi32(x, Op::apply(low, x), 0xF0);
+    }
+    //! The last value of x in each position
+    static __m256i last(__m256i x) { return _mm256_permutevar8x32_epi32(x, _mm256_set1_epi32(7)); }
+    //! The values of x shifted up by one position, with the first value of c shifted in
+    static __m256i shift_in(__m256i x, __m256i c) {
+        return _mm256_blend_epi32(_mm256_permutevar8x32_epi32(x, _mm256_setr_epi32(0, 0, 1, 2, 3, 4, 5, 6)), c, 0x01);
+    }
+};
+
+template<class Op>
+struct simd_scan_register<Op, 8> {
+    //! Inclusive scan of the 4 values of x
+    static __m256i scan(__m256i x) {
+        x = _mm256_blend_epi32(x, Op::apply(_mm256_slli_si256(x, 8), x), 0xCC);
+        const __m256i low = _mm256_shuffle_epi32(_mm256_permute2x128_si256(x, x, 0x08), 0xEE);
+        return _mm256_blend_epi32(x, Op::apply(low, x), 0xF0);
+    }
+    static __m256i last(__m256i x) { return _mm256_permute4x64_epi64(x, 0xFF); }
+    static __m256i shift_in(__m256i x, __m256i c) { return _mm256_blend_epi32(_mm256_permute4x64_epi64(x, 0x90), c, 0x03); }
+};
+#endif /* __PSTL_SIMD_SCAN_AVX2_PRESENT */
+
+//! Operation in registers that computes binary_op on values of type T, if any
+template<class BinaryOperation, class T>
+struct simd_scan_operation: simd_scan_op<typename simd_scan_tag<BinaryOperation, T>::type, sizeof(T),
+    std::is_signed<T>::value, std::is_floating_point<T>::value> {};
+
+//! Whether simd_scan computes the scans of values of type T with binary_op
+template<class BinaryOperation, class T>
+struct is_simd_scan_operation: std::integral_constant<bool,
+    std::is_arithmetic<T>::value && !std::is_same<T, bool>::value && simd_scan_operation<BinaryOperation, T>::is_supported> {};
+
+#if __PSTL_SIMD_SCAN_AVX2_PRESENT
+//! Scan of the values unary_op(first[i]) for i in [0,n) starting with init; returns the end of the output and the combination of all
+/** Each block of values that fits in a register is scanned by log-step shifts and combinations,
+    then combined with the carry, which holds the combination of init with the blocks before it. */
+template<class InputIterator, class DifferenceType, class OutputIterator, class UnaryOperation, class T, class BinaryOperation, class Inclusive>
+std::pair<OutputIterator,T> simd_scan(InputIterator first, DifferenceType n, OutputIterator result, UnaryOperation unary_op, T init, BinaryOperation binary_op, Inclusive) noexcept {
+    typedef simd_scan_operation<BinaryOperation, T> op;
+    typedef simd_scan_register<op, sizeof(T)> reg;
+    const DifferenceType size = sizeof(__m256i)/sizeof(T);
+    alignas(__m256i) T x[sizeof(__m256i)/sizeof(T)];
+    std::fill(x, x + size, init);
+    __m256i carry = _mm256_load_si256(reinterpret_cast<const __m256i*>(x));
+    DifferenceType i = 0;
+    for(; n - i >= size; i += size) {
+__PSTL_PRAGMA_SIMD
+        for(DifferenceType j = 0; j < size; ++j)
+            x[j] = unary_op(first[i + j]);
+        const __m256i block = reg::scan(_mm256_load_si256(reinterpret_cast<const __m256i*>(x)));
+        __m256i v = op::apply(carry, block);
+        if(!Inclusive::value)
+            v = reg::shift_in(v, carry);
+        // The carry does not wait for the shuffles of the block
+        carry = op::apply(carry, reg::last(block));
+        _mm256_store_si256(reinterpret_cast<__m256i*>(x), v);
+__PSTL_PRAGMA_SIMD
+        for(DifferenceType j = 0; j < size; ++j)
+            result[i + j] = x[j];
+    }
+    _mm256_store_si256(reinterpret_cast<__m256i*>(x), carry);
+    init = x[0];
+    for(; i < n; ++i) {
+        const T z = unary_op(first[i]);
+        if(Inclusive::value) {
+            init = binary_op(init, z);
+            result[i] = init;
+        } else {
+            result[i] = init;
+            init = binary_op(init, z);
+        }
+    }
+    return std::make_pair(result + n, init);
+}
+#endif /* __PSTL_SIMD_SCAN_AVX2_PRESENT */
+
+//! Number of bytes of the partial sums that simd_reduce keeps, enough for two of the widest registers
+const std::size_t SIMD_REDUCE_BYTES = 128;
+
+//! Number of partial sums of values of type T that simd_reduce keeps
+template<typename T>
+struct simd_reduce_lanes: std::integral_constant<std::size_t, sizeof(T) < SIMD_REDUCE_BYTES ? SIMD_REDUCE_BYTES/sizeof(T) : 1> {};
+
+//! Reduction of value(i) for i in [0,n) with init
+/** Lane j of the partial sums reduces the values i with i%lanes==j, and the lanes are reduced with init
+    at the end, so binary_op must be associative and commutative. */
+template<typename DifferenceType, typename T, typename BinaryOperation, typename Value>
+T simd_reduce(DifferenceType n, T init, BinaryOperation binary_op, Value value) noexcept {
+    const DifferenceType lanes = simd_reduce_lanes<T>::value;
+    DifferenceType i = 0;
+    if(n >= 2*lanes) {
+        T sum[simd_reduce_lanes<T>::value];
+__PSTL_PRAGMA_SIMD
+        for(DifferenceType j = 0; j < lanes; ++j)
+            sum[j] = value(j);
+        for(i = lanes; n - i >= lanes; i += lanes) {
+__PSTL_PRAGMA_SIMD
+            for(DifferenceType j = 0; j < lanes; ++j)
+                sum[j] = binary_op(sum[j], value(i + j));
+        }
+        for(DifferenceType j = 0; j < lanes; ++j)
+            init = binary_op(init, sum[j]);
+    }
+    for(; i < n; ++i)
+        init = binary_op(init, value(i));
+    return init;
+}
+
+//! Compensated sum of value(i) for i in [0,n), added to sum and error
+/** Each lane keeps its own sum and error, which are added to sum and error at the end. */
+template<typename DifferenceType, typename T, typename Value>
+void simd_compensated_reduce(DifferenceType n, T& sum, T& error, Value value) noexcept {
+    const DifferenceType lanes = simd_reduce_lanes<T>::value;
+    DifferenceType i = 0;
+    if(n >= 2*lanes) {
+        T lane_sum[simd_reduce_lanes<T>::value];
+        T lane_error[simd_reduce_lanes<T>::value];
+__PSTL_PRAGMA_SIMD
+        for(DifferenceType j = 0; j < lanes; ++j) {
+            lane_sum[j] = value(j);
+            lane_error[j] = T(0);
+        }
+        for(i = lanes; i < n - n%lanes; i += lanes) {
+__PSTL_PRAGMA_SIMD
+            for(DifferenceType j = 0; j < lanes; ++j)
+                compensated_add(lane_sum[j], lane_error[j], T(value(i + j)));
+        }
+        for(DifferenceType j = 0; j < lanes; ++j) {
+            compensated_add(sum, error, lane_sum[j]);
+            error += lane_error[j];
+        }
+    }
+    for(; i < n; ++i)
+        compensated_add(sum, error, T(value(i)));
+}
+
+//! Maximal number of bins that simd_histogram counts
+const std::size_t SIMD_HISTOGRAM_MAX_BINS = 64;
+//! Number of lanes of simd_histogram
+const std::size_t SIMD_HISTOGRAM_LANES = 16;
+
+//! Add the number of i in [0,n) with bin(i)==b to bins[b], for each b in [0,nbins) with nbins <= SIMD_HISTOGRAM_MAX_BINS
+/** Each lane counts into its own copy of the bins, so the increments of a vector never conflict.
+    The values of bin(i) that are not less than nbins are counted in an extra bin, and ignored. */
+template<typename DifferenceType, typename RandomAccessIterator, typename Bin>
+void simd_histogram(DifferenceType n, RandomAccessIterator bins, std::size_t nbins, Bin bin) noexcept {
+    const DifferenceType lanes = SIMD_HISTOGRAM_LANES;
+    std::size_t count[(SIMD_HISTOGRAM_MAX_BINS + 1)*SIMD_HISTOGRAM_LANES];
+    std::fill(count, count + (nbins + 1)*lanes, std::size_t(0));
+    DifferenceType i = 0;
+    for(; n - i >= lanes; i += lanes) {
+__PSTL_PRAGMA_SIMD
+        for(DifferenceType j = 0; j < lanes; ++j) {
+            const std::size_t b = bin(i + j);
+            ++count[(b < nbins ? b : nbins)*lanes + j];
+        }
+    }
+    for(; i < n; ++i) {
+        const std::size_t b = bin(i);
+        ++count[(b < nbins ? b : nbins)*lanes];
+    }
+    for(std::size_t b = 0; b < nbins; ++b) {
+        std::size_t sum = 0;
+        for(DifferenceType j = 0; j < lanes; ++j)
+            sum += count[b*lanes + j];
+        bins[b] += sum;
+    }
+}
+
 template<class Iterator, class DifferenceType, class Function>
 Iterator simd_it_walk_1(Iterator first, DifferenceType n, Function f) noexcept {
 __PSTL_PRAGMA_SIMD
@@ -447,6 +806,91 @@ __PSTL_PRAGMA_SIMD_ORDERED_MONOTONIC_2ARGS(cnt_true:1, cnt_false : 1)
     }
     return std::make_pair(out_true + cnt_true, out_false + cnt_false);
 }
+
+//------------------------------------------------------------------------
+// sort
+//------------------------------------------------------------------------
+
+//! Maximal number of elements sorted by simd_sort
+const std::size_t SIMD_SORT_MAX_SIZE = 512;
+//! Number of rows in a block sorted by the sorting network
+const std::size_t SIMD_SORT_NETWORK_SIZE = 16;
+
+//! Compare-exchange of all columns of rows a and b, leaving the lesser values in row a
+template<class T, class DifferenceType, class Compare>
+void simd_compare_exchange(T* a, T* b, DifferenceType n, Compare comp) noexcept {
+__PSTL_PRAGMA_SIMD
+    for(DifferenceType i = 0; i < n; ++i) {
+        const T x = a[i];
+        const T y = b[i];
+        const bool swap = comp(y, x);
+        a[i] = swap ? y : x;
+        b[i] = swap ? x : y;
+    }
+}
+
+//! Merge without data dependent branches, to avoid branch mispredictions
+template<class T, class Compare>
+T* simd_merge(const T* xs, const T* xe, const T* ys, const T* ye, T* zs, Compare comp) noexcept {
+    while(xs != xe && ys != ye) {
+        const bool take_y = comp(*ys, *xs);
+        *zs = take_y ? *ys : *xs;
+        ++zs;
+        ys += take_y;
+        xs += !take_y;
+    }
+    zs = std::copy(xs, xe, zs);
+    return std::copy(ys, ye, zs);
+}
+
+//! Sort n <= SIMD_SORT_MAX_SIZE values of arithmetic type
+/** The first n/SIMD_SORT_NETWORK_SIZE*SIMD_SORT_NETWORK_SIZE values are viewed as SIMD_SORT_NETWORK_SIZE rows.
+    A bitonic sorting network applied to whole rows sorts every column at once. The sorted columns and
+    the sorted remainder are then merged bottom-up. The sort is not stable. */
+template<class RandomAccessIterator, class DifferenceType, class Compare>
+void simd_sort(RandomAccessIterator first, DifferenceType n, Compare comp) noexcept {
+    typedef typename std::iterator_traits<RandomAccessIterator>::value_type T;
+    const DifferenceType rows = SIMD_SORT_NETWORK_SIZE;
+    const DifferenceType columns = n / rows;
+    const DifferenceType m = rows * columns;
+    T x[SIMD_SORT_MAX_SIZE];
+    T y[SIMD_SORT_MAX_SIZE];
+
+    std::copy(first, first + n, x);
+    if(columns > 0) {
+        for(DifferenceType k = 2; k <= rows; k *= 2)
+            for(DifferenceType j = k / 2; j > 0; j /= 2)
+                for(DifferenceType i = 0; i < rows; ++i) {
+                    const DifferenceType l = i ^ j;
+                    if(l > i) {
+                        if((i & k) == 0)
+                            simd_compare_exchange(x + i*columns, x + l*columns, columns, comp);
+                        else
+                            simd_compare_exchange(x + l*columns, x + i*columns, columns, comp);
+                    }
+                }
+        // Transpose, so that each sorted column becomes a contiguous run
+        for(DifferenceType i = 0; i < rows; ++i) {
+__PSTL_PRAGMA_SIMD
+            for(DifferenceType j = 0; j < columns; ++j)
+                y[j*rows + i] = x[i*columns + j];
+        }
+    }
+    std::copy(x + m, x + n, y + m);
+    std::sort(y + m, y + n, comp);
+
+    T* src = y;
+    T* dst = x;
+    for(DifferenceType width = rows; width < n; width *= 2) {
+        for(DifferenceType lo = 0; lo < n; lo += 2*width) {
+            const DifferenceType mid = std::min(lo + width, n);
+            const DifferenceType hi = std::min(mid + width, n);
+            simd_merge(src + lo, src + mid, src + mid, src + hi, dst + lo, comp);
+        }
+        std::swap(src, dst);
+    }
+    std::copy(src, src + n, first);
+}
 } // namespace internal
 } // namespace pstl
 
@@ -25,30 +25,7 @@
 #include <tuple>
 #include <cassert>
 
-#if __PSTL_CPP14_INTEGER_SEQUENCE_PRESENT
-
-#include <utility>
-namespace pstl {
-    namespace internal {
-        using std::index_sequence;
-        using std::make_index_sequence;
-    } //internal
-}//namespace pstl
-
-#else //std::integer_sequence is not present
-namespace pstl {
-    namespace internal {
-template<std::size_t... S> class index_sequence {};
-template<std::size_t N, std::size_t... S>
-struct make_index_sequence_impl : make_index_sequence_impl < N - 1, N - 1, S... > {};
-template<std::size_t... S>
-struct make_index_sequence_impl <0, S...> {
-    typedef index_sequence<S...> type;
-};
-template<std::size_t N> struct make_index_sequence: internal::make_index_sequence_impl<N>::type {};
-} //internal
-}//namespace pstl
-#endif
+#include "internal/common.h"
 
 namespace pstl {
 namespace internal {
@@ -138,7 +115,7 @@ class zip_iterator {
     static const std::size_t num_types = sizeof...(Types);
     typedef typename std::tuple<Types...> it_types;
 public:
-    typedef typename std::make_signed<std::size_t>::type difference_type;
+    typedef typename std::common_type<typename std::iterator_traits<Types>::difference_type...>::type difference_type;
     typedef std::tuple<typename std::iterator_traits<Types>::value_type...> value_type;
     typedef std::tuple<typename std::iterator_traits<Types>::reference...> reference;
     typedef std::tuple<typename std::iterator_traits<Types>::pointer...> pointer;
@@ -146,11 +123,14 @@ public:
 
     explicit zip_iterator(Types... args): my_it(std::make_tuple(args...)) {}
 
-    reference operator*() {
+    reference operator*() const {
         return internal::make_references<reference>()(my_it, pstl::internal::make_index_sequence<num_types>());
     }
     reference operator[](difference_type i) const { return *(*this + i); }
 
+    //! The component iterators, which the vectorized algorithms index directly
+    const it_types& base() const { return my_it; }
+
     difference_type operator-(const zip_iterator<Types...>& it) const {
         assert((internal::tuple_util<num_types>::check_sync(my_it, it.my_it, std::get<0>(my_it) - std::get<0>(it.my_it))));
         return std::get<0>(my_it) - std::get<0>(it.my_it);
@@ -185,10 +165,7 @@ public:
     }
     friend zip_iterator operator+(difference_type forward, const zip_iterator<Types...>& it) { return it + forward; }
 
-    bool operator==(const zip_iterator<Types...>& it) const {
-        assert((internal::tuple_util<num_types>::check_sync(my_it, it.my_it, *this - it)));
-        return *this - it == 0;
-    }
+    bool operator==(const zip_iterator<Types...>& it) const { return *this - it == 0; }
     bool operator!=(const zip_iterator<Types...>& it) const { return !(*this == it); }
     bool operator<(const zip_iterator<Types...>& it) const { return *this - it < 0; }
     bool operator>(const zip_iterator<Types...>& it) const { return it < *this; }
@@ -0,0 +1,84 @@
+/*
+    Copyright (c) 2017 Intel Corporation
+
+    Licensed under the Apache License, Version 2.0 (the "License");
+    you may not use this file except in compliance with the License.
+    You may obtain a copy of the License at
+
+        http://www.apache.org/licenses/LICENSE-2.0
+
+    Unless required by applicable law or agreed to in writing, software
+    distributed under the License is distributed on an "AS IS" BASIS,
+    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+    See the License for the specific language governing permissions and
+    limitations under the License.
+
+
+
+
+*/
+
+// Tests for the asynchronous variants of the algorithms
+
+#include <stdexcept>
+
+#include "pstl/execution"
+#include "pstl/async"
+#include "test/utils.h"
+
+using namespace TestUtils;
+
+template<typename Policy>
+void test_async(const Policy& exec, const char* name) {
+    const size_t n = 100000;
+    Sequence<int32_t> a(n, [](size_t k) { return int32_t((k * 7919) % 100003); });
+    Sequence<int32_t> b(n, [](size_t k) { return int32_t(k % 17); });
+    Sequence<int64_t> prefix_sums(n);
+
+    // Two algorithms over unrelated data run at the same time
+    pstl::async::future<void> sorted = pstl::async::sort(exec, a.begin(), a.end());
+    pstl::async::future<int64_t> sum = pstl::async::transform_reduce(exec, b.begin(), b.end(), int64_t(0),
+        std::plus<int64_t>(), [](int32_t x) { return int64_t(x); });
+    EXPECT_TRUE(sum.get() == std::accumulate(b.begin(), b.end(), int64_t(0)), (std::string("wrong transform_reduce with ") + name).c_str());
+    sorted.wait();
+    EXPECT_TRUE(sorted.is_ready(), (std::string("sort is not ready after wait with ") + name).c_str());
+    EXPECT_TRUE(std::is_sorted(a.begin(), a.end()), (std::string("wrong sort with ") + name).c_str());
+
+    // A chain of algorithms, each started when the previous one is ready
+    pstl::async::future<bool> found = pstl::async::fill(exec, b.begin(), b.end(), int32_t(1))
+        .then([&](pstl::async::future<void>) {
+            std::inclusive_scan(exec, b.begin(), b.end(), prefix_sums.begin(), std::plus<int64_t>(), int64_t(0));
+        })
+        .then([&](pstl::async::future<void>) {
+            return std::binary_search(prefix_sums.begin(), prefix_sums.end(), int64_t(n));
+        });
+    EXPECT_TRUE(found.get(), (std::string("wrong chain with ") + name).c_str());
+    EXPECT_TRUE(prefix_sums[n - 1] == int64_t(n), (std::string("wrong inclusive_scan in chain with ") + name).c_str());
+
+    // An exception of a continuation is rethrown by get() of its future
+    pstl::async::future<int32_t> failed = pstl::async::count(exec, b.begin(), b.end(), int32_t(1))
+        .then([](pstl::async::future<typename std::iterator_traits<int32_t*>::difference_type> count) -> int32_t {
+            if( count.get() == int64_t(n) )
+                throw std::runtime_error("expected");
+            return 0;
+        });
+    bool is_thrown = false;
+    try {
+        failed.get();
+    }
+    catch(const std::runtime_error&) {
+        is_thrown = true;
+    }
+    EXPECT_TRUE(is_thrown, (std::string("exception is lost with ") + name).c_str());
+}
+
+int32_t main() {
+    using namespace pstl::execution;
+    test_async(seq, "seq");
+#if __PSTL_USE_PAR_POLICIES
+    test_async(par, "par");
+    test_async(par_unseq.with_concurrency(2), "par_unseq.with_concurrency(2)");
+#endif
+    std::cout << "done" << std::endl;
+    return 0;
+}
@@ -0,0 +1,79 @@
+/*
+    Copyright (c) 2017 Intel Corporation
+
+    Licensed under the Apache License, Version 2.0 (the "License");
+    you may not use this file except in compliance with the License.
+    You may obtain a copy of the License at
+
+        http://www.apache.org/licenses/LICENSE-2.0
+
+    Unless required by applicable law or agreed to in writing, software
+    distributed under the License is distributed on an "AS IS" BASIS,
+    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+    See the License for the specific language governing permissions and
+    limitations under the License.
+
+
+
+
+*/
+
+// Tests for histogram
+
+#include "pstl/execution"
+#include "pstl/algorithm"
+#include "test/utils.h"
+
+using namespace TestUtils;
+
+//! Bin of a value in [0,1) when there are nbins bins
+struct scaled_bin {
+    float64_t scale;
+    int64_t operator()(float64_t x) const { return int64_t(x*scale); }
+};
+
+struct test_histogram {
+    template <typename Policy, typename Iterator, typename Bins, typename KeyFunction>
+    void operator()(Policy&& exec, Iterator first, Iterator last, std::size_t nbins, KeyFunction key, Bins bins) {
+        std::vector<int64_t> expected(nbins);
+        for(Iterator i = first; i != last; ++i) {
+            const int64_t b = key(*i);
+            if(0 <= b && std::size_t(b) < nbins)
+                ++expected[b];
+        }
+        std::fill_n(bins, nbins, int64_t(-1));
+        Bins result = pstl::histogram(exec, first, last, bins, nbins, key);
+        EXPECT_TRUE(result == bins + nbins, "wrong return value from histogram");
+        EXPECT_EQ_N(expected.begin(), bins, nbins, "wrong effect from histogram");
+    }
+};
+
+//! Bin of an integer that is its value
+struct identity_bin {
+    int64_t operator()(int32_t x) const { return x; }
+};
+
+void test_by_bins(std::size_t nbins) {
+    std::vector<int64_t> bins(nbins);
+    for(size_t n = 0; n < 100000; n = n <= 16 ? n + 1 : size_t(3.1415 * n)) {
+        // Some values fall outside the bins on both sides
+        Sequence<int32_t> in(n, [nbins](size_t) { return int32_t(std::rand() % (nbins + 10)) - 5; });
+        invoke_on_all_policies(test_histogram(), in.begin(), in.end(), nbins, identity_bin(), bins.begin());
+        Sequence<float64_t> x(n, [](size_t) { return float64_t(std::rand())/(float64_t(RAND_MAX) + 1); });
+        invoke_on_all_policies(test_histogram(), x.begin(), x.end(), nbins, scaled_bin{float64_t(nbins)}, bins.begin());
+    }
+}
+
+int32_t main() {
+    std::srand(42);
+    // Bins counted by lanes, per thread, and by partitions
+    for(std::size_t nbins : {1, 7, 64, 65, 1000, 1<<15})
+        test_by_bins(nbins);
+    // Bins of integers without a key function
+    std::vector<int16_t> values{3, 0, 3, 2, 9, -1, 3};
+    std::vector<int32_t> bins(4);
+    pstl::histogram(pstl::execution::par_unseq, values.begin(), values.end(), bins.begin(), bins.size());
+    EXPECT_TRUE(bins == std::vector<int32_t>({1, 0, 1, 3}), "wrong effect from histogram without a key function");
+    std::cout << "done" << std::endl;
+    return 0;
+}
@@ -71,6 +71,15 @@ struct test_counting_iterator {
         auto res = std::all_of(in.begin(), in.end(), [&value](const T& a) {return a==value;});
         EXPECT_TRUE(res, "wrong result with counting_iterator iterator");
 
+        //checks in the searching and counting algorithms
+        const IntType n = end - begin;
+        EXPECT_TRUE(std::count_if(exec, b, e, [](IntType i) { return i % 3 == 0; }) == (n + 2) / 3,
+                    "wrong result of count_if with counting_iterator");
+        EXPECT_TRUE(std::any_of(exec, b, e, [n](IntType i) { return i == n - 1; }) == (n > 0),
+                    "wrong result of any_of with counting_iterator");
+        EXPECT_TRUE(std::find_if(exec, b, e, [n](IntType i) { return 2 * i >= n; }) - b == (n + 1) / 2,
+                    "wrong result of find_if with counting_iterator");
+
         //explicit checks of the counting iterator specific
         EXPECT_TRUE(b[0]==0, "wrong result with operator[] for an iterator");
         EXPECT_TRUE(*(b + 1) == 1, "wrong result with operator+ for an iterator");
@@ -0,0 +1,77 @@
+/*
+    Copyright (c) 2017 Intel Corporation
+
+    Licensed under the Apache License, Version 2.0 (the "License");
+    you may not use this file except in compliance with the License.
+    You may obtain a copy of the License at
+
+        http://www.apache.org/licenses/LICENSE-2.0
+
+    Unless required by applicable law or agreed to in writing, software
+    distributed under the License is distributed on an "AS IS" BASIS,
+    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+    See the License for the specific language governing permissions and
+    limitations under the License.
+
+
+
+
+*/
+
+// Tests for multi_transform_reduce
+
+#include "pstl/execution"
+#include "pstl/numeric"
+#include "test/utils.h"
+
+using namespace TestUtils;
+
+struct square {
+    template<typename T>
+    T operator()(T x) const { return x*x; }
+};
+
+struct test_multi_transform_reduce {
+    template <typename Policy, typename Iterator>
+    void operator()(Policy&& exec, Iterator first, Iterator last) {
+        typedef typename std::iterator_traits<Iterator>::value_type T;
+        // Sum, sum of squares, minimum, maximum and count of odd values
+        T sum = T(0), sum_of_squares = T(0), lo = std::numeric_limits<T>::max(), hi = std::numeric_limits<T>::lowest();
+        int64_t odd = 0;
+        for(Iterator i = first; i != last; ++i) {
+            sum += *i;
+            sum_of_squares += *i * *i;
+            lo = std::min(lo, *i);
+            hi = std::max(hi, *i);
+            odd += int64_t(*i) % 2 != 0;
+        }
+        auto result = pstl::multi_transform_reduce(exec, first, last,
+            pstl::make_transform_reduction(T(0), std::plus<T>()),
+            pstl::make_transform_reduction(T(0), std::plus<T>(), square()),
+            pstl::make_transform_reduction(std::numeric_limits<T>::max(), pstl::minimum<T>()),
+            pstl::make_transform_reduction(std::numeric_limits<T>::lowest(), pstl::maximum<T>()),
+            pstl::make_transform_reduction(int64_t(0), std::plus<int64_t>(), [](T x) { return int64_t(int64_t(x) % 2 != 0); }));
+        EXPECT_EQ(sum, std::get<0>(result), "wrong sum from multi_transform_reduce");
+        EXPECT_EQ(sum_of_squares, std::get<1>(result), "wrong sum of squares from multi_transform_reduce");
+        EXPECT_EQ(lo, std::get<2>(result), "wrong minimum from multi_transform_reduce");
+        EXPECT_EQ(hi, std::get<3>(result), "wrong maximum from multi_transform_reduce");
+        EXPECT_EQ(odd, std::get<4>(result), "wrong count from multi_transform_reduce");
+    }
+};
+
+template <typename T>
+void test() {
+    for(size_t n = 0; n < 100000; n = n <= 16 ? n + 1 : size_t(3.1415 * n)) {
+        // Small integral values, so that the sums are exact in any order
+        Sequence<T> in(n, [](size_t k) { return T(int32_t(k*7919 % 201) - 100); });
+        invoke_on_all_policies(test_multi_transform_reduce(), in.begin(), in.end());
+        invoke_on_all_policies(test_multi_transform_reduce(), in.cbegin(), in.cend());
+    }
+}
+
+int32_t main() {
+    test<int32_t>();
+    test<float64_t>();
+    std::cout << "done" << std::endl;
+    return 0;
+}
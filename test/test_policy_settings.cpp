@@ -0,0 +1,155 @@
+/*
+    Copyright (c) 2017 Intel Corporation
+
+    Licensed under the Apache License, Version 2.0 (the "License");
+    you may not use this file except in compliance with the License.
+    You may obtain a copy of the License at
+
+        http://www.apache.org/licenses/LICENSE-2.0
+
+    Unless required by applicable law or agreed to in writing, software
+    distributed under the License is distributed on an "AS IS" BASIS,
+    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+    See the License for the specific language governing permissions and
+    limitations under the License.
+
+
+
+
+*/
+
+// Tests for the run-time settings of parallel policies
+
+#include <cmath>
+#include <cstring>
+#include <limits>
+#include <mutex>
+#include <set>
+#include <thread>
+
+#include "pstl/execution"
+#include "pstl/algorithm"
+#include "pstl/numeric"
+#include "test/utils.h"
+
+using namespace TestUtils;
+
+#if __PSTL_USE_PAR_POLICIES
+//! Set of the threads that executed a body
+class thread_set {
+    std::mutex my_mutex;
+    std::set<std::thread::id> my_ids;
+public:
+    void insert() {
+        std::lock_guard<std::mutex> lock(my_mutex);
+        my_ids.insert(std::this_thread::get_id());
+    }
+    size_t size() const { return my_ids.size(); }
+};
+
+template<typename Policy>
+void test_algorithms(const Policy& exec, size_t limit, const char* name) {
+    const size_t n = 1000000;
+    Sequence<int32_t> in(n, [](size_t k) { return int32_t((k * 7919) % 100003); });
+    Sequence<int64_t> prefix_sums(n);
+    Sequence<int32_t> out(n);
+
+    thread_set threads;
+    std::for_each(exec, in.begin(), in.end(), [&threads](int32_t& x) {
+        if( x % 1000 == 0 )
+            threads.insert();
+    });
+    EXPECT_TRUE(threads.size() <= limit, (std::string("for_each used too many threads with ") + name).c_str());
+
+    const int64_t sum = std::transform_reduce(exec, in.begin(), in.end(), int64_t(0), std::plus<int64_t>(),
+        [](int32_t x) { return int64_t(x); });
+    EXPECT_TRUE(std::accumulate(in.begin(), in.end(), int64_t(0)) == sum, (std::string("wrong transform_reduce with ") + name).c_str());
+
+    std::inclusive_scan(exec, in.begin(), in.end(), prefix_sums.begin(), std::plus<int64_t>(), int64_t(0));
+    int64_t prefix = 0;
+    for( size_t k = 0; k < n; ++k ) {
+        prefix += in[k];
+        if( prefix_sums[k] != prefix ) {
+            EXPECT_TRUE(false, (std::string("wrong inclusive_scan with ") + name).c_str());
+            break;
+        }
+    }
+
+    std::copy(in.begin(), in.end(), out.begin());
+    std::sort(exec, out.begin(), out.end());
+    EXPECT_TRUE(std::is_sorted(out.begin(), out.end()), (std::string("wrong sort with ") + name).c_str());
+
+    EXPECT_TRUE(std::find(exec, in.begin(), in.end(), in[n - 2]) == std::find(in.begin(), in.end(), in[n - 2]),
+                (std::string("wrong find with ") + name).c_str());
+}
+
+//! True if x and y have the same bits
+bool same_bits(float64_t x, float64_t y) {
+    return std::memcmp(&x, &y, sizeof(x)) == 0;
+}
+
+//! Check that the reductions and scans with policy.with_reproducible() give the same bits on any number of threads
+template<typename Policy>
+void test_reproducible(const Policy& exec, const char* name) {
+    // Terms of very different magnitudes, whose sum depends on the order of the additions
+    const size_t n = 100003;
+    Sequence<float64_t> in(n, [](size_t k) { return std::sin(float64_t(k))*std::pow(10.0, float64_t(k % 17) - 8); });
+    Sequence<float64_t> expected_scan(n), scan(n);
+
+    const auto serial = exec.with_concurrency(1);
+    const float64_t expected_sum = std::reduce(serial, in.begin(), in.end(), 0.5);
+    const float64_t expected_dot = std::transform_reduce(serial, in.begin(), in.end(), in.begin(), 0.0);
+    std::inclusive_scan(serial, in.begin(), in.end(), expected_scan.begin());
+    for( size_t threads = 2; threads <= 8; threads *= 2 ) {
+        const auto parallel = exec.with_concurrency(threads);
+        const std::string message = std::string(" differs on ") + std::to_string(threads) + " threads with " + name;
+        for( int repeat = 0; repeat < 3; ++repeat ) {
+            EXPECT_TRUE(same_bits(std::reduce(parallel, in.begin(), in.end(), 0.5), expected_sum), ("reduce" + message).c_str());
+            EXPECT_TRUE(same_bits(std::transform_reduce(parallel, in.begin(), in.end(), in.begin(), 0.0), expected_dot),
+                        ("transform_reduce" + message).c_str());
+            std::inclusive_scan(parallel, in.begin(), in.end(), scan.begin());
+            EXPECT_TRUE(std::equal(scan.begin(), scan.end(), expected_scan.begin(), same_bits), ("inclusive_scan" + message).c_str());
+        }
+    }
+    const float64_t sum = std::accumulate(in.begin(), in.end(), 0.5);
+    EXPECT_TRUE(std::fabs(expected_sum - sum) <= 1e-6*std::fabs(sum), (std::string("wrong reduce with ") + name).c_str());
+}
+#endif
+
+int32_t main() {
+#if __PSTL_USE_PAR_POLICIES
+    using namespace pstl::execution;
+    const size_t max_threads = std::numeric_limits<size_t>::max();
+    test_algorithms(par.with_concurrency(2), 2, "par.with_concurrency(2)");
+    test_algorithms(par_unseq.with_concurrency(1), 1, "par_unseq.with_concurrency(1)");
+    test_algorithms(par.with_concurrency(1).with_concurrency(3), 3, "chained with_concurrency");
+    test_algorithms(par.with_chunk(4096), max_threads, "par.with_chunk(4096)");
+    test_algorithms(par_unseq.with_chunk(1), max_threads, "par_unseq.with_chunk(1)");
+    test_algorithms(par.with_partitioner(partitioner::static_), max_threads, "par.with_partitioner(partitioner::static_)");
+    test_algorithms(par_unseq.with_partitioner(partitioner::static_).with_chunk(100).with_concurrency(2), 2,
+                    "par_unseq.with_partitioner(partitioner::static_).with_chunk(100).with_concurrency(2)");
+    test_algorithms(par.with_serial_cutoff(2000000), 1, "par.with_serial_cutoff(2000000)");
+    test_algorithms(par_unseq.with_serial_cutoff(1000), max_threads, "par_unseq.with_serial_cutoff(1000)");
+    test_algorithms(par.with_auto_cutoff(), max_threads, "par.with_auto_cutoff()");
+    test_algorithms(par_unseq.with_auto_cutoff().with_concurrency(2), 2, "par_unseq.with_auto_cutoff().with_concurrency(2)");
+    affinity sweeps;
+    for( int k = 0; k < 3; ++k )
+        test_algorithms(par_unseq.with_affinity(sweeps), max_threads, "par_unseq.with_affinity(sweeps)");
+    test_algorithms(par.with_affinity(sweeps).with_chunk(4096).with_concurrency(2), 2,
+                    "par.with_affinity(sweeps).with_chunk(4096).with_concurrency(2)");
+    test_algorithms(par.with_numa(), max_threads, "par.with_numa()");
+    test_algorithms(par_unseq.with_numa().with_chunk(1000), max_threads, "par_unseq.with_numa().with_chunk(1000)");
+    test_algorithms(par.with_reproducible(), max_threads, "par.with_reproducible()");
+    test_algorithms(par_unseq.with_reproducible().with_chunk(1000).with_concurrency(2), 2,
+                    "par_unseq.with_reproducible().with_chunk(1000).with_concurrency(2)");
+    test_reproducible(par.with_reproducible(), "par.with_reproducible()");
+    test_reproducible(par_unseq.with_reproducible().with_auto_cutoff(), "par_unseq.with_reproducible().with_auto_cutoff()");
+    test_reproducible(par_unseq.with_reproducible().with_chunk(777), "par_unseq.with_reproducible().with_chunk(777)");
+#if __PSTL_USE_TBB
+    tbb::task_arena arena(2);
+    test_algorithms(par_unseq.on(arena), 2, "par_unseq.on(arena)");
+#endif
+#endif
+    std::cout << "done" << std::endl;
+    return 0;
+}
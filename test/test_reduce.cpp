@@ -18,6 +18,8 @@
 
 */
 
+#include <cmath>
+
 #include "pstl/execution"
 #include "pstl/numeric"
 #include "test/utils.h"
@@ -25,6 +27,18 @@
 
 using namespace TestUtils;
 
+//! Operation of the user that is declared vectorizable
+struct MaxAbs {
+    int32_t operator()(int32_t a, int32_t b) const {
+        return (a < 0 ? -a : a) < (b < 0 ? -b : b) ? b : a;
+    }
+};
+
+namespace pstl {
+template<>
+struct is_vectorizable_reduction<MaxAbs, int32_t>: std::true_type {};
+}
+
 struct test_long_forms_for_one_policy {
     template <typename Policy, typename Iterator, typename T, typename BinaryOp>
     void operator()( Policy&& exec, Iterator first, Iterator last, T init, BinaryOp binary, T expected ) {
@@ -83,16 +97,64 @@ void test_short_forms() {
     }
 }
  
+struct test_accurate_sums_for_one_policy {
+    template <typename Policy, typename Iterator>
+    void operator()(Policy&& exec, Iterator first, Iterator last, long double exact, long double magnitude) {
+        using namespace std;
+        const size_t n = std::distance(first, last);
+        // The compensated sum is about as accurate as the rounding of the exact sum
+        const float32_t compensated = reduce(exec, first, last, 0.0f, pstl::compensated_plus<float32_t>());
+        EXPECT_TRUE(fabsl(compensated - exact) <= 2*numeric_limits<float32_t>::epsilon()*fabsl(exact) + 1e-6L*magnitude,
+                    "inaccurate result from reduce(exec, first, last, init, compensated_plus)");
+        const float32_t dot = transform_reduce(exec, first, last, first, 0.0f, pstl::compensated_plus<>(),
+                                               [](float32_t x, float32_t y) { return x*y; });
+        EXPECT_TRUE(std::isfinite(dot) && dot >= 0, "bad result from transform_reduce(exec, first1, last1, first2, init, compensated_plus, op)");
+        // The sum of floats with a double init accumulates in double
+        const float64_t wide = reduce(exec, first, last, 0.0);
+        EXPECT_TRUE(fabsl(wide - exact) <= n*numeric_limits<float64_t>::epsilon()*magnitude,
+                    "inaccurate result from reduce(exec, first, last, double init)");
+        const float64_t wide_compensated = reduce(exec, first, last, 0.0, pstl::compensated_plus<float64_t>());
+        EXPECT_TRUE(fabsl(wide_compensated - exact) <= 2*numeric_limits<float64_t>::epsilon()*fabsl(exact) + 1e-14L*magnitude,
+                    "inaccurate result from reduce(exec, first, last, double init, compensated_plus)");
+    }
+};
+
+//! Test the reductions that keep the accuracy of sums of many floats of various magnitudes
+void test_accurate_sums() {
+    for( size_t n=0; n<=1000000; n = n<=16 ? n+1 : size_t(3.1415 * n) ) {
+        Sequence<float32_t> in(n, [](size_t k) {
+            return float32_t(std::sin(float64_t(k))*std::pow(10.0, int32_t(k % 7) - 3));
+        });
+        long double exact = 0, magnitude = 0;
+        for( size_t k=0; k<n; ++k ) {
+            exact += in[k];
+            magnitude += fabsl(in[k]);
+        }
+        invoke_on_all_policies(test_accurate_sums_for_one_policy(), in.begin(), in.end(), exact, magnitude);
+    }
+}
+
 int32_t main( ) {
     // Test for popular types 
     test_long_form(42, std::plus<int32_t>(), [](int32_t x) {return x;});
     test_long_form(42.0, std::plus<float64_t>(), [](float64_t x) {return x;});
 
+    // Test for the operations that are reduced in SIMD lanes
+    test_long_form(0u, std::bit_or<uint32_t>(), [](int32_t x) {return uint32_t(1) << (x & 31);});
+    test_long_form(~0u, std::bit_and<uint32_t>(), [](int32_t x) {return ~(uint32_t(1) << (x & 31));});
+    test_long_form(int64_t(7), std::bit_xor<int64_t>(), [](int32_t x) {return int64_t(x)*x;});
+    test_long_form(1.0, std::multiplies<float64_t>(), [](int32_t x) {return x == 0 ? 2.0 : x == 1 ? 0.5 : 1.0;});
+    test_long_form(42, pstl::minimum<int32_t>(), [](int32_t x) {return x;});
+    test_long_form(-1000.0f, pstl::maximum<>(), [](int32_t x) {return float32_t(x);});
+    test_long_form(0, MaxAbs(), [](int32_t x) {return x;});
+
     // Test for strict types 
     test_long_form<Number>(Number(42,OddTag()), Add(OddTag()), [](int32_t x) {return Number(x,OddTag());});
 
     // Short forms are just facade for long forms, so just test with a single type.
     test_short_forms();
+
+    test_accurate_sums();
     std::cout << "done" << std::endl;
     return 0;
 }
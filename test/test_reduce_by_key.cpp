@@ -0,0 +1,133 @@
+/*
+    Copyright (c) 2017 Intel Corporation
+
+    Licensed under the Apache License, Version 2.0 (the "License");
+    you may not use this file except in compliance with the License.
+    You may obtain a copy of the License at
+
+        http://www.apache.org/licenses/LICENSE-2.0
+
+    Unless required by applicable law or agreed to in writing, software
+    distributed under the License is distributed on an "AS IS" BASIS,
+    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+    See the License for the specific language governing permissions and
+    limitations under the License.
+
+
+
+
+*/
+
+// Tests for reduce_by_key, inclusive_scan_by_key and exclusive_scan_by_key
+
+#include "pstl/execution"
+#include "pstl/numeric"
+#include "test/utils.h"
+
+using namespace TestUtils;
+
+//! Keys are equivalent when they are in the same decade
+struct same_decade {
+    bool operator()(int32_t x, int32_t y) const { return x / 10 == y / 10; }
+};
+
+struct test_reduce_by_key {
+    template <typename Policy, typename Iterator1, typename Iterator2, typename Iterator3, typename Iterator4>
+    void operator()(Policy&& exec, Iterator1 keys_first, Iterator1 keys_last, Iterator2 values_first, Iterator2 values_last,
+                    Iterator3 out_keys, Iterator4 out_values) {
+        typedef typename std::iterator_traits<Iterator2>::value_type T;
+        const auto n = std::distance(keys_first, keys_last);
+        // Expected results
+        std::vector<int32_t> expected_keys;
+        std::vector<T> expected_values;
+        Iterator2 v = values_first;
+        for(Iterator1 k = keys_first; k != keys_last; ++k, ++v) {
+            if(expected_keys.empty() || !(*k / 10 == expected_keys.back() / 10)) {
+                expected_keys.push_back(*k);
+                expected_values.push_back(*v);
+            }
+            else
+                expected_values.back() += *v;
+        }
+
+        std::fill_n(out_keys, n, -1);
+        std::fill_n(out_values, n, T(-1));
+        auto result = pstl::reduce_by_key(exec, keys_first, keys_last, values_first, out_keys, out_values, same_decade());
+        EXPECT_TRUE(std::distance(out_keys, result.first) == std::distance(expected_keys.begin(), expected_keys.end()), "wrong number of keys from reduce_by_key");
+        EXPECT_TRUE(std::distance(out_values, result.second) == std::distance(expected_values.begin(), expected_values.end()), "wrong number of values from reduce_by_key");
+        std::vector<int32_t> keys(out_keys, std::next(out_keys, expected_keys.size()));
+        std::vector<T> values(out_values, std::next(out_values, expected_values.size()));
+        EXPECT_EQ_N(expected_keys.begin(), keys.begin(), expected_keys.size(), "wrong keys from reduce_by_key");
+        EXPECT_EQ_N(expected_values.begin(), values.begin(), expected_values.size(), "wrong values from reduce_by_key");
+    }
+};
+
+struct test_scan_by_key {
+    template <typename Policy, typename Iterator1, typename Iterator2, typename Iterator3>
+    void operator()(Policy&& exec, Iterator1 keys_first, Iterator1 keys_last, Iterator2 values_first, Iterator2 values_last,
+                    Iterator3 out_first, bool inclusive) {
+        typedef typename std::iterator_traits<Iterator2>::value_type T;
+        const auto n = std::distance(keys_first, keys_last);
+        const T init = T(7);
+        // Expected results
+        std::vector<T> expected;
+        T sum = init;
+        Iterator1 previous = keys_first;
+        Iterator2 v = values_first;
+        for(Iterator1 k = keys_first; k != keys_last; previous = k, ++k, ++v) {
+            if(k == keys_first || *k != *previous)
+                sum = inclusive ? T(0) : init;
+            if(inclusive)
+                expected.push_back(sum += *v);
+            else {
+                expected.push_back(sum);
+                sum += *v;
+            }
+        }
+
+        std::fill_n(out_first, n, T(-1));
+        Iterator3 result = inclusive
+            ? pstl::inclusive_scan_by_key(exec, keys_first, keys_last, values_first, out_first)
+            : pstl::exclusive_scan_by_key(exec, keys_first, keys_last, values_first, out_first, init);
+        EXPECT_TRUE(result == std::next(out_first, n), "wrong return value from scan by key");
+        std::vector<T> actual(out_first, std::next(out_first, n));
+        EXPECT_EQ_N(expected.begin(), actual.begin(), expected.size(), inclusive ? "wrong effect from inclusive_scan_by_key" : "wrong effect from exclusive_scan_by_key");
+    }
+};
+
+template <typename T>
+void test_by_key(size_t segment) {
+    for(size_t n = 0; n < 100000; n = n <= 16 ? n + 1 : size_t(3.1415 * n)) {
+        // Keys form runs of random lengths up to segment
+        int32_t key = 0;
+        size_t left = 0;
+        Sequence<int32_t> keys(n, [&](size_t) {
+            if(left == 0) {
+                left = 1 + std::rand() % segment;
+                key += 1 + std::rand() % 20;
+            }
+            --left;
+            return key;
+        });
+        // Small integral values, so that the sums are exact in any order
+        Sequence<T> values(n, [](size_t k) { return T(k % 7 + 1); });
+        Sequence<int32_t> out_keys(n);
+        Sequence<T> out_values(n);
+        invoke_on_all_policies(test_reduce_by_key(), keys.begin(), keys.end(), values.begin(), values.end(),
+                               out_keys.begin(), out_values.begin());
+        invoke_on_all_policies(test_scan_by_key(), keys.begin(), keys.end(), values.begin(), values.end(),
+                               out_values.begin(), true);
+        invoke_on_all_policies(test_scan_by_key(), keys.begin(), keys.end(), values.begin(), values.end(),
+                               out_values.begin(), false);
+    }
+}
+
+int32_t main() {
+    std::srand(42);
+    for(size_t segment : {1, 3, 100, 5000, 1000000}) {
+        test_by_key<int32_t>(segment);
+        test_by_key<float64_t>(segment);
+    }
+    std::cout << "done" << std::endl;
+    return 0;
+}
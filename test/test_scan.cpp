@@ -18,6 +18,8 @@
 
 */
 
+#include <limits>
+
 #include "pstl/execution"
 #include "pstl/numeric"
 #include "test/utils.h"
@@ -166,6 +168,22 @@ int32_t main() {
             inclusive ? 0.0 : -1.0,
             -666.0,
             [](uint32_t k) {return float64_t((k%991+1)^(k%997+2));});
+
+        // Operations that the vectorized scans recognize
+        test_with_plus<int32_t>(
+            inclusive ? 0 : 7,
+            -666,
+            [](uint32_t k) {return int32_t(k%7) - 3;});
+        test_with_binary_op<int32_t>(
+            std::numeric_limits<int32_t>::max(),
+            pstl::minimum<int32_t>(),
+            -666,
+            [](uint32_t k) {return int32_t(k*7919%10007) - int32_t(k);});
+        test_with_binary_op<float32_t>(
+            -1.0f,
+            pstl::maximum<>(),
+            -666.0f,
+            [](uint32_t k) {return float32_t(k*7919%10007);});
     }
     std::cout << "done" << std::endl;
     return 0;
@@ -29,6 +29,10 @@ using namespace TestUtils;
 #define _CRT_SECURE_NO_WARNINGS
 
 #include <atomic>
+#include <string>
+#if __PSTL_USE_TBB
+#include <tbb/task_arena.h>
+#endif
 
 static bool Stable;
 
@@ -134,6 +138,8 @@ static bool Equal(float32_t x, float32_t y ) {return x==y;}
 
 static bool Equal(int32_t x, int32_t y ) {return x==y;}
 
+static bool Equal(const std::string& x, const std::string& y ) {return x==y;}
+
 struct test_sort_with_compare {
     template <typename Policy, typename InputIterator, typename OutputIterator, typename OutputIterator2, typename Size, typename Compare>
     typename std::enable_if<is_same_iterator_category<InputIterator, std::random_access_iterator_tag>::value, void>::type
@@ -187,7 +193,22 @@ int32_t main() {
                          [](size_t, size_t val) {return float32_t(val);});
         test_sort<int32_t>([](int32_t x, int32_t y) {return x>y;},  // Reversed so accidental use of < will be detected.
                        [](size_t, size_t val) {return int32_t(val);});
+        // Few distinct keys, so that many keys are equal to the splitters of a sample sort.
+        // std::greater allows stable_sort to use the vectorized leaf sort.
+        test_sort<int32_t>(std::greater<int32_t>(),
+                       [](size_t, size_t val) {return int32_t(val%3);});
+        // Strings with long common prefixes, sorted with the default comparator.
+        test_sort<std::string>(std::less<std::string>(),
+                       [](size_t, size_t val) {return std::string(val%7*4, 'a') + std::to_string(val);});
     }
+#if __PSTL_USE_TBB
+    // Several threads, so that parallel stable_sort combines its chunks with a multiway merge.
+    Stable = true;
+    tbb::task_arena arena(4);
+    arena.execute([]() {
+        test_sort<ParanoidKey>(KeyCompare(OddTag()), [](size_t k, size_t val) {return ParanoidKey(k, val, OddTag());});
+    });
+#endif
     std::cout << "done" << std::endl;
     return 0;
 }
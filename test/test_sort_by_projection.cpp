@@ -0,0 +1,90 @@
+/*
+    Copyright (c) 2017 Intel Corporation
+
+    Licensed under the Apache License, Version 2.0 (the "License");
+    you may not use this file except in compliance with the License.
+    You may obtain a copy of the License at
+
+        http://www.apache.org/licenses/LICENSE-2.0
+
+    Unless required by applicable law or agreed to in writing, software
+    distributed under the License is distributed on an "AS IS" BASIS,
+    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+    See the License for the specific language governing permissions and
+    limitations under the License.
+
+
+
+
+*/
+
+// Tests for sort_by_projection and stable_sort_by_projection
+
+#include "pstl/execution"
+#include "pstl/algorithm"
+#include "test/utils.h"
+
+using namespace TestUtils;
+
+//! A record that is much bigger than its key
+struct Record {
+    int64_t key;
+    int32_t index;
+    char payload[52];
+    Record() : key(0), index(0) {}
+    Record(int64_t key_, int32_t index_) : key(key_), index(index_) {
+        std::fill(payload, payload + sizeof(payload), char(index_));
+    }
+    bool consistent() const {
+        return std::count(payload, payload + sizeof(payload), char(index)) == sizeof(payload);
+    }
+};
+
+struct Key {
+    int64_t operator()(const Record& r) const { return r.key; }
+};
+
+struct test_sort_by_projection {
+    template <typename Policy, typename Iterator, typename InputIterator>
+    typename std::enable_if<is_same_iterator_category<Iterator, std::random_access_iterator_tag>::value, void>::type
+    operator()(Policy&& exec, Iterator first, Iterator last, Iterator expected_first, Iterator expected_last, InputIterator in, bool stable) {
+        std::copy_n(in, last - first, first);
+        std::copy_n(in, last - first, expected_first);
+        if(stable) {
+            std::stable_sort(expected_first, expected_last, [](const Record& x, const Record& y) { return x.key > y.key; });
+            pstl::stable_sort_by_projection(exec, first, last, Key(), std::greater<int64_t>());
+        }
+        else {
+            std::sort(expected_first, expected_last, [](const Record& x, const Record& y) { return x.key < y.key; });
+            pstl::sort_by_projection(exec, first, last, Key());
+        }
+        for(; first != last; ++first, ++expected_first) {
+            EXPECT_TRUE(first->consistent(), "record is damaged");
+            EXPECT_EQ(expected_first->key, first->key, "wrong order of keys");
+            if(stable)
+                EXPECT_EQ(expected_first->index, first->index, "order of equal keys is not preserved");
+        }
+    }
+
+    template <typename Policy, typename Iterator, typename InputIterator>
+    typename std::enable_if<!is_same_iterator_category<Iterator, std::random_access_iterator_tag>::value, void>::type
+    operator()(Policy&& exec, Iterator first, Iterator last, Iterator expected_first, Iterator expected_last, InputIterator in, bool stable) {}
+};
+
+void test_by_projection(bool stable) {
+    for(size_t n = 0; n < 100000; n = n <= 16 ? n + 1 : size_t(3.1415 * n)) {
+        // Keys are drawn from a small range, so that there are many equal keys
+        Sequence<Record> in(n, [n](size_t k) { return Record(std::rand() % (n/4 + 1), int32_t(k)); });
+        Sequence<Record> expected(in);
+        Sequence<Record> tmp(in);
+        invoke_on_all_policies(test_sort_by_projection(), tmp.begin(), tmp.end(), expected.begin(), expected.end(), in.begin(), stable);
+    }
+}
+
+int32_t main() {
+    std::srand(42);
+    test_by_projection(false);
+    test_by_projection(true);
+    std::cout << "done" << std::endl;
+    return 0;
+}
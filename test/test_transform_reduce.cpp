@@ -87,6 +87,40 @@ struct test_transform_reduce {
     }
 };
 
+//! Product of three values, for the weighted dot product
+struct Product3 {
+    template <typename T>
+    T operator()(const T& w, const T& x, const T& y) const { return w*x*y; }
+};
+
+// Test for the reduction over three ranges
+struct test_transform_reduce_n {
+    template <typename Policy, typename Iterator1, typename Iterator2, typename Iterator3, typename T, typename BinaryOperation>
+    typename std::enable_if<is_same_iterator_category<Iterator1, std::random_access_iterator_tag>::value, void>::type
+    operator()(Policy&& exec, Iterator1 first1, Iterator1 last1, Iterator2 first2, Iterator2 last2, Iterator3 first3, T init, BinaryOperation op) {
+        T expected = init;
+        for(auto n = last1 - first1, i = decltype(n)(0); i < n; ++i)
+            expected = op(expected, Product3()(first1[i], first2[i], first3[i]));
+        T result = pstl::transform_reduce(exec, init, op, Product3(), first1, last1, first2, first3);
+        EXPECT_EQ(expected, result, "wrong result of transform_reduce over three ranges");
+    }
+
+    template <typename Policy, typename Iterator1, typename Iterator2, typename Iterator3, typename T, typename BinaryOperation>
+    typename std::enable_if<!is_same_iterator_category<Iterator1, std::random_access_iterator_tag>::value, void>::type
+    operator()(Policy&& exec, Iterator1 first1, Iterator1 last1, Iterator2 first2, Iterator2 last2, Iterator3 first3, T init, BinaryOperation op) {}
+};
+
+template <typename T, typename BinaryOperation>
+void test_by_type_n(T init, BinaryOperation op) {
+    std::size_t maxSize = 100000;
+    // Small values, so that the results are exact in any order
+    Sequence<T> in1(maxSize, [](std::size_t k) { return T(k % 3); });
+    Sequence<T> in2(maxSize, [](std::size_t k) { return T(k % 5) - 2; });
+    Sequence<T> in3(maxSize, [](std::size_t k) { return T(k % 7); });
+
+    for (std::size_t n = 0; n < maxSize; n = n < 16 ? n + 1 : size_t(3.1415 * n))
+        invoke_on_all_policies(test_transform_reduce_n(), in1.begin(), in1.begin() + n, in2.begin(), in2.begin() + n, in3.begin(), init, op);
+}
 
 template <typename T, typename BinaryOperation1, typename BinaryOperation2, typename UnaryOp, typename Initializer>
 void test_by_type(T init, BinaryOperation1 opB1, BinaryOperation2 opB2, UnaryOp opU, Initializer initObj) {
@@ -123,6 +157,11 @@ int32_t main() {
         std::negate<MyClass>(),
         [](std::size_t a)->MyClass {return MyClass(rand() % 1000); });
 
+    test_by_type_n<int32_t>(42, std::plus<int32_t>());
+    test_by_type_n<float64_t>(0, std::plus<float64_t>());
+    test_by_type_n<int32_t>(0, pstl::maximum<int32_t>());
+    test_by_type_n<int64_t>(0, [](int64_t a, int64_t b) { return a + b; });
+
     std::cout << "done" << std::endl;
     return 0;
 }